@@ -5,8 +5,11 @@ DROP VIEW IF EXISTS plcontainer_show_config;
 
 DROP FUNCTION IF EXISTS plcontainer_refresh_local_config(verbose bool);
 DROP FUNCTION IF EXISTS plcontainer_show_local_config();
+DROP FUNCTION IF EXISTS plcontainer_containers_registry();
+DROP FUNCTION IF EXISTS plcontainer_containers_registry();
 
 DROP TYPE IF EXISTS container_summary_type;
+DROP TYPE IF EXISTS container_registry_type;
 
 DROP LANGUAGE IF EXISTS plcontainer CASCADE;
 DROP FUNCTION IF EXISTS plcontainer_call_handler();
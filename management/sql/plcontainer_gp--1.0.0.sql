@@ -51,4 +51,10 @@ CREATE OR REPLACE VIEW plcontainer_refresh_config as
 
 CREATE OR REPLACE FUNCTION plcontainer_containers_summary() RETURNS setof container_summary_type
 AS '$libdir/plcontainer', 'containers_summary'
+LANGUAGE C VOLATILE;
+
+CREATE TYPE container_registry_type AS ("QE_PID" int4, "SESSION_ID" int4, "COMMAND_COUNT" int4, "RUNTIME_ID" text, "OWNER" text, "CONTAINER_ID" text, "SERVER_PID" int4);
+
+CREATE OR REPLACE FUNCTION plcontainer_containers_registry() RETURNS setof container_registry_type
+AS '$libdir/plcontainer', 'containers_registry'
 LANGUAGE C VOLATILE;
\ No newline at end of file
@@ -18,6 +18,12 @@ LANGUAGE C VOLATILE;
 
 CREATE TYPE container_summary_type AS ("SEGMENT_ID" text, "CONTAINER_ID" text, "UP_TIME" text, "OWNER" text, "MEMORY_USAGE(KB)" text);
 
+CREATE TYPE container_registry_type AS ("QE_PID" int4, "SESSION_ID" int4, "COMMAND_COUNT" int4, "RUNTIME_ID" text, "OWNER" text, "CONTAINER_ID" text, "SERVER_PID" int4);
+
+CREATE OR REPLACE FUNCTION plcontainer_containers_registry() RETURNS setof container_registry_type
+AS '$libdir/plcontainer', 'containers_registry'
+LANGUAGE C VOLATILE;
+
 CREATE OR REPLACE VIEW plcontainer_show_config as
     select -1, plcontainer_show_local_config();
 
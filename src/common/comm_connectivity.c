@@ -25,6 +25,9 @@ void plcContextInit(plcContext *ctx)
 {
 	ctx->service_address = NULL;
 	ctx->container_id = NULL;
+	ctx->command_count = 0;
+	ctx->generation = 0;
+	ctx->owner = NULL;
 	ctx->current_stage_num = 0;
 	ctx->max_stage_num = MAX_PLC_CONTEXT_STAGE_NUM;
 	ctx->is_new_ctx = true;
@@ -63,6 +66,8 @@ void plcFreeContext(plcContext *ctx)
 	plcReleaseContext(ctx);
 	pfree(ctx->service_address);
 	pfree(ctx->container_id);
+	if (ctx->owner)
+		pfree(ctx->owner);
 	pfree(ctx);
 	global_context = NULL;
 }
@@ -1,6 +1,7 @@
 #include <stdarg.h>
 #include "postgres.h"
 #include "lib/stringinfo.h"
+#include "utils/guc.h"
 #include "utils/memutils.h"
 #include "common/comm_dummy.h"
 #include "common/comm_connectivity.h"
@@ -31,6 +32,22 @@ void plc_elog(int log_level, const char *format, ...)
 	pfree(buf.data);
 }
 
+/*
+ * Whether a message of log_level reaches either the server log or the
+ * client, the same decision elog() makes after formatting it.
+ */
+bool plc_log_enabled(int log_level)
+{
+	if (log_level >= ERROR)
+		return true;
+
+	/* LOG ranks above ERROR for the server log */
+	if (log_level == LOG || log_level == COMMERROR)
+		return log_min_messages <= ERROR || client_min_messages <= LOG;
+
+	return log_level >= log_min_messages || log_level >= client_min_messages;
+}
+
 void *txn_palloc(size_t size) {
 	/* Allocat memory to live in the transcation level */
 	if (TopTransactionContext != NULL)
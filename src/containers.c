@@ -41,6 +41,7 @@
 typedef struct {
 	char *runtimeid;
 	plcContext *ctx;
+	int checked_ccnt;	/* the last command its registration was checked in */
 } container_t;
 
 #define MAX_CONTAINER_NUMBER 10
@@ -51,11 +52,15 @@ static CoordinatorStruct *coordinator_shm;
 static int check_runtime_id(const char *id);
 static plcContext *get_new_container_ctx(const char *runtime_id);
 static void insert_container_ctx(const char *runtime_id, plcContext *ctx, int slot);
+static void release_containers(int timeout_ms);
+static void release_containers_at_exit(int code, Datum arg);
+static void renew_container_ctx(const char *runtime_id, plcContext *ctx);
 
 static void insert_container_ctx(const char *runtime_id, plcContext *ctx, int slot)
 {
 	containers[slot].runtimeid = plc_top_strdup(runtime_id);
 	containers[slot].ctx = ctx;
+	containers[slot].checked_ccnt = gp_command_count;
 }
 
 plcContext *get_container_context(const char *runtime_id)
@@ -70,6 +75,15 @@ plcContext *get_container_context(const char *runtime_id)
 	{
 		if (strcmp(containers[i].runtimeid, runtime_id) == 0)
 		{
+			/*
+			 * The coordinator unregisters containers that exited or were
+			 * removed, checked once per command.
+			 */
+			if (containers[i].checked_ccnt != gp_command_count) {
+				if (!lookup_container(getpid(), gp_session_id, containers[i].ctx->command_count, containers[i].ctx->container_id))
+					renew_container_ctx(runtime_id, containers[i].ctx);
+				containers[i].checked_ccnt = gp_command_count;
+			}
 			/* Re-init data buffer and plan slot */
 			plcContextReset(containers[i].ctx);
 			plcContextBeginStage(containers[i].ctx, "get_cached_container", NULL);
@@ -96,6 +110,13 @@ static plcContext *get_new_container_ctx(const char *runtime_id)
 {
 	plcContext *ctx = NULL;
 	int res = 0;
+	static bool exit_callback_registered = false;
+
+	/* with plcontainer.reuse_containers new sessions may get our containers */
+	if (!exit_callback_registered) {
+		before_shmem_exit(release_containers_at_exit, (Datum) 0);
+		exit_callback_registered = true;
+	}
 
 	/* TODO: the initialize refactor? */
 	ctx = (plcContext*) top_palloc(sizeof(plcContext));
@@ -108,6 +129,24 @@ static plcContext *get_new_container_ctx(const char *runtime_id)
 	return ctx;
 }
 
+/*
+ * Point ctx to a new container in place of its gone one, so that whoever holds
+ * ctx, e.g. buffered batch rows, follows.
+ */
+static void renew_container_ctx(const char *runtime_id, plcContext *ctx)
+{
+	char *service_address = ctx->service_address;
+	char *container_id = ctx->container_id;
+
+	plc_elog(LOG, "container %s is gone, requesting a new one", container_id);
+	plcontainer_release_channel(service_address);
+	if (get_new_container_from_coordinator(runtime_id, ctx) != 0) {
+		elog(ERROR, "Cannot find an available container");
+	}
+	pfree(service_address);
+	pfree(container_id);
+}
+
 // TODO: read shm to get the address of coordinator
 char *get_coordinator_address(void) {
 	bool found;
@@ -118,8 +157,19 @@ char *get_coordinator_address(void) {
 }
 
 void reset_containers() {
+	release_containers(CONTAINER_CONNECT_TIMEOUT_MS);
+}
+
+/*
+ * Disconnect from all containers, handing them back to the coordinator for
+ * reuse within timeout_ms each if plcontainer.reuse_containers is on.
+ */
+static void release_containers(int timeout_ms) {
 	int i;
 
+	/* buffered rows refer to the contexts released below */
+	plcontainer_discard_batch();
+
 	for (i = 0; i < containers_size; i++) {
 		if (containers[i].runtimeid != NULL) {
 			/*
@@ -132,8 +182,14 @@ void reset_containers() {
 			char *runtimeid = containers[i].runtimeid;
 			containers[i].runtimeid = NULL;
 			containers[i].ctx = NULL;
-			if (ctx)
+			if (ctx) {
+				/* otherwise it is removed once the QE exits */
+				if (plc_reuse_containers)
+					plcontainer_release_container(runtimeid, ctx, timeout_ms);
+				if (ctx->service_address)
+					plcontainer_release_channel(ctx->service_address);
 				plcFreeContext(ctx);
+			}
 			pfree(runtimeid);
 		}
 	}
@@ -141,6 +197,16 @@ void reset_containers() {
 	memset((void *)containers, 0, sizeof(containers));
 }
 
+/*
+ * Outside of any transaction, so nothing here may read the catalog. The
+ * coordinator is not waited for long, the containers it does not get back
+ * are removed once the QE is gone.
+ */
+static void release_containers_at_exit(pg_attribute_unused() int code, pg_attribute_unused() Datum arg) {
+	if (plc_reuse_containers)
+		release_containers(RELEASE_AT_EXIT_TIMEOUT_MS);
+}
+
 char *parse_container_meta(const char *source) {
 	int first, last, len;
 	char *runtime_id = NULL;
@@ -1,15 +1,132 @@
 #include "docker/docker_client.h"
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <mutex>
 #include <utility>
 #include <sstream>
 
+static std::once_flag curl_global_once;
+static CURLSH *curl_share;
+static std::mutex curl_share_locks[CURL_LOCK_DATA_LAST];
+
+static void curl_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    curl_share_locks[data].lock();
+}
+
+static void curl_share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    curl_share_locks[data].unlock();
+}
+
+/*
+ * Clients are created on the coordinator's worker threads as well, and
+ * curl_global_init/curl_global_cleanup are not thread safe. Initialize curl
+ * once per process and leave the cleanup to process exit. Only the DNS
+ * cache is shared between the clients, curl does not support sharing the
+ * connection cache between threads. Each client keeps its connections in its
+ * own multi handle.
+ */
+static void curl_init_once() {
+    std::call_once(curl_global_once, []() {
+        curl_global_init(CURL_GLOBAL_ALL);
+        curl_share = curl_share_init();
+        if (curl_share != nullptr) {
+            curl_share_setopt(curl_share, CURLSHOPT_LOCKFUNC, curl_share_lock);
+            curl_share_setopt(curl_share, CURLSHOPT_UNLOCKFUNC, curl_share_unlock);
+            curl_share_setopt(curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        }
+    });
+}
+
 Docker::Docker() : host_uri("http:/v1.40"){
-    curl_global_init(CURL_GLOBAL_ALL);
+    curl_init_once();
     is_remote = false;
     mActiveTransfers = 0;
+    mTimeoutMs = -1;
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    curlm = curl_multi_init();
+    if (curlm != nullptr) {
+        curl_multi_setopt(curlm, CURLMOPT_SOCKETFUNCTION, socketCallback);
+        curl_multi_setopt(curlm, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(curlm, CURLMOPT_TIMERFUNCTION, timerCallback);
+        curl_multi_setopt(curlm, CURLMOPT_TIMERDATA, this);
+    }
 }
 
 Docker::~Docker(){
-    curl_global_cleanup();
+    for (CURL *curl : idleHandles) {
+        curl_easy_cleanup(curl);
+    }
+    if (curlm != nullptr) {
+        curl_multi_cleanup(curlm);
+    }
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+    }
+}
+
+// curl tells which of its sockets to wait for, they are kept in mEpollFd
+int Docker::socketCallback(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp) {
+    Docker *docker = static_cast<Docker *>(userp);
+    struct epoll_event event;
+
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(docker->mEpollFd, EPOLL_CTL_DEL, s, nullptr);
+        return 0;
+    }
+    memset(&event, 0, sizeof(event));
+    event.data.fd = s;
+    event.events = ((what & CURL_POLL_IN) ? EPOLLIN : 0) | ((what & CURL_POLL_OUT) ? EPOLLOUT : 0);
+    if (epoll_ctl(docker->mEpollFd, EPOLL_CTL_MOD, s, &event) < 0 && errno == ENOENT) {
+        epoll_ctl(docker->mEpollFd, EPOLL_CTL_ADD, s, &event);
+    }
+    return 0;
+}
+
+int Docker::timerCallback(CURLM *multi, long timeout_ms, void *userp) {
+    static_cast<Docker *>(userp)->mTimeoutMs = timeout_ms;
+    return 0;
+}
+
+/*
+ * Run the transfers added to curlm to completion. Only the sockets curl
+ * reported ready are handed to it, and the waits follow curl's own timer.
+ */
+void Docker::driveTransfers() {
+    struct epoll_event events[16];
+    int n;
+
+    if (mEpollFd < 0) {
+        return;
+    }
+    curl_multi_socket_action(curlm, CURL_SOCKET_TIMEOUT, 0, &mActiveTransfers);
+    while (mActiveTransfers > 0) {
+        // no timer set: wait for the sockets, but look again once a second
+        n = epoll_wait(mEpollFd, events, 16, (mTimeoutMs < 0 || mTimeoutMs > 1000) ? 1000 : (int) mTimeoutMs);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (n == 0) {
+            curl_multi_socket_action(curlm, CURL_SOCKET_TIMEOUT, 0, &mActiveTransfers);
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            int flags = 0;
+            if (events[i].events & EPOLLIN) {
+                flags |= CURL_CSELECT_IN;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flags |= CURL_CSELECT_OUT;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                flags |= CURL_CSELECT_ERR;
+            }
+            curl_multi_socket_action(curlm, events[i].data.fd, flags, &mActiveTransfers);
+        }
+    }
 }
 
 JSON_DOC Docker::inspect_containers(const std::vector<std::string>& container_ids){
@@ -79,96 +196,162 @@ JSON_DOC Docker::stat_containers(const std::vector<std::string>& container_ids,
     JSON_DOC param = JSON_DOC();
     return requestAndParse(GET,paths,param);
 }
-int Docker::multiCurlRequests(std::string& readBuffer, const std::vector<std::string>& paths, JSON_DOC& param, std::string method_str) {
-    curlm = curl_multi_init();
+/*
+ * Batched endpoints, one request per container run concurrently, with a
+ * response per container.
+ */
+std::vector<DockerResponse> Docker::create_containers(const std::vector<std::string>& parameters){
+    std::vector<DockerRequest> requests(parameters.size());
+    for (unsigned int i = 0; i < parameters.size(); i++) {
+        requests[i].path = "/containers/create";
+        requests[i].body = parameters[i];
+    }
+    return performRequests("POST", requests);
+}
+
+std::vector<DockerResponse> Docker::start_containers(const std::vector<std::string>& container_ids){
+    std::vector<DockerRequest> requests(container_ids.size());
+    for (unsigned int i = 0; i < container_ids.size(); i++) {
+        requests[i].path = "/containers/" + container_ids[i] + "/start";
+    }
+    return performRequests("POST", requests);
+}
+
+std::vector<DockerResponse> Docker::stop_containers(const std::vector<std::string>& container_ids, int delay){
+    std::vector<DockerRequest> requests(container_ids.size());
+    for (unsigned int i = 0; i < container_ids.size(); i++) {
+        requests[i].path = "/containers/" + container_ids[i] + "/stop?" + param("t", delay);
+    }
+    return performRequests("POST", requests);
+}
+
+std::vector<DockerResponse> Docker::remove_containers(const std::vector<std::string>& container_ids, bool v, bool force){
+    std::vector<DockerRequest> requests(container_ids.size());
+    for (unsigned int i = 0; i < container_ids.size(); i++) {
+        requests[i].path = "/containers/" + container_ids[i] + "?" + param("v", v) + param("force", force);
+    }
+    return performRequests("DELETE", requests);
+}
+
+std::vector<DockerResponse> Docker::inspect_each_container(const std::vector<std::string>& container_ids){
+    std::vector<DockerRequest> requests(container_ids.size());
+    for (unsigned int i = 0; i < container_ids.size(); i++) {
+        requests[i].path = "/containers/" + container_ids[i] + "/json";
+    }
+    return performRequests("GET", requests);
+}
+
+std::vector<DockerResponse> Docker::stat_each_container(const std::vector<std::string>& container_ids){
+    std::vector<DockerRequest> requests(container_ids.size());
+    for (unsigned int i = 0; i < container_ids.size(); i++) {
+        requests[i].path = "/containers/" + container_ids[i] + "/stats?" + param("stream", false);
+    }
+    return performRequests("GET", requests);
+}
+
+// the unparsed body, for parseJsonFields()
+DockerResponse Docker::list_containers_raw(JSON_DOC& filters, bool all){
+    std::vector<DockerRequest> requests(1);
+    requests[0].path = "/containers/json?" + param("all", all) + param("filters", filters);
+    return performRequests("GET", requests)[0];
+}
+
+CURL *Docker::takeHandle() {
+    CURL *curl;
+    if (idleHandles.empty()) {
+        return curl_easy_init();
+    }
+    curl = idleHandles.back();
+    idleHandles.pop_back();
+    // keeps the connections, forgets the options of the last request
+    curl_easy_reset(curl);
+    return curl;
+}
+
+/*
+ * Run the requests concurrently on the reused handles, the responses are in
+ * the order of the requests.
+ */
+std::vector<DockerResponse> Docker::performRequests(const std::string& method_str, const std::vector<DockerRequest>& requests) {
+    std::vector<DockerResponse> responses(requests.size());
     std::vector<CURL *> handles;
+    struct curl_slist *headers = nullptr;
+
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        responses[i].result = CURLE_FAILED_INIT;
+        responses[i].code = 0;
+    }
     if(!curlm){
-        //plc_elog("error while initiating curl");
-        curl_global_cleanup();
-        exit(1);
+        return responses;
     }
-    rapidjson::StringBuffer buffer;
-    std::string paramString;
-    const char *paramChar;
-    struct curl_slist *headers = nullptr;
-    buffer.Clear();
-    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-    param.Accept(writer);
-    paramString = std::string(buffer.GetString());
-    paramChar = paramString.c_str();
     headers = curl_slist_append(headers, "Content-Type: application/json");
 
-    for (unsigned int i = 0; i < paths.size(); i++) {
-        CURL* curl = curl_easy_init();
+    for (unsigned int i = 0; i < requests.size(); i++) {
+        CURL* curl = takeHandle();
+        if (curl == nullptr) {
+            break;
+        }
         handles.push_back(curl);
-        std::string path = paths[i];
+        curl_easy_setopt(curl, CURLOPT_SHARE, curl_share);
         curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, "/var/run/docker.sock");
-        curl_easy_setopt(curl, CURLOPT_URL, (host_uri + path).c_str());
+        curl_easy_setopt(curl, CURLOPT_URL, (host_uri + requests[i].path).c_str());
         curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method_str.c_str());
         curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responses[i].data);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, &responses[i]);
         if(method_str == "POST"){
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, paramChar);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(paramChar));
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, requests[i].body.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) requests[i].body.length());
         }
         curl_multi_add_handle(curlm, curl);
     }
-    CURLMcode res;
-    while ((res = curl_multi_perform(curlm, &mActiveTransfers)) == CURLM_CALL_MULTI_PERFORM) {}
-    if(res != CURLM_OK)
-        fprintf(stderr, "curl_easy_perform() failed: %s\n",
-            curl_multi_strerror(res));
-    while (mActiveTransfers) {
-        int rc = 0;
-        fd_set fdread, fdwrite, fdexecp;
-        int maxfd = -1;
-        long curl_timeno = -1;
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-        FD_ZERO(&fdread);
-        FD_ZERO(&fdwrite);
-        FD_ZERO(&fdexecp);
-        curl_multi_timeout(curlm, &curl_timeno);
-        if (curl_timeno > 0) {
-            timeout.tv_sec = curl_timeno/1000;
-            if (timeout.tv_sec > 1)
-                timeout.tv_sec = 1;
-            else
-                timeout.tv_usec = (curl_timeno % 1000) * 1000;
-        }
-        res = curl_multi_fdset(curlm, &fdread, &fdwrite, &fdexecp, &maxfd);
-        if (res != CURLM_OK) {
-            fprintf(stderr, "curl_multi_fdset() failed: %s\n", strerror(errno));
-        }
-        if (maxfd == -1) {
-            fprintf(stderr, "No socket");
-        } else {
-            rc = select(maxfd+1, &fdread, &fdwrite, &fdexecp, &timeout);
-        }
-        switch(rc) {
-        case -1:
-            fprintf(stderr, "select() failed: %s\n", strerror(errno));
-            if (errno == EINTR || errno == EAGAIN) {
-            }
-            break;
-        case 0:
-        default:
-            curl_multi_perform(curlm, &mActiveTransfers);
-            break;
+    driveTransfers();
+    struct CURLMsg *m;
+    do {
+        int msgq = 0;
+        m = curl_multi_info_read(curlm, &msgq);
+        if (m && (m->msg == CURLMSG_DONE)) {
+            DockerResponse *response = nullptr;
+            curl_easy_getinfo(m->easy_handle, CURLINFO_PRIVATE, (char **) &response);
+            response->result = m->data.result;
+            curl_easy_getinfo(m->easy_handle, CURLINFO_RESPONSE_CODE, &response->code);
         }
+    } while(m);
+    for (CURL *curl : handles) {
+        curl_multi_remove_handle(curlm, curl);
+        idleHandles.push_back(curl);
     }
     curl_slist_free_all(headers);
-    curl_multi_cleanup(curlm);
-    for(unsigned int i = 0; i<paths.size(); i++)
-        curl_easy_cleanup(handles[i]);
 
-    return 0;
+    return responses;
 }
 
-JSON_DOC Docker::requestAndParse(Method method, const std::vector<std::string>& paths, JSON_DOC& param, long success_code){
-    std::string readBuffer;
+/*
+ * Same request with the same body on each path, the responses are appended
+ * to readBuffer. Returns CURLE_OK or the error of the first failed request.
+ */
+CURLcode Docker::multiCurlRequests(std::string& readBuffer, const std::vector<std::string>& paths, JSON_DOC& param, std::string method_str) {
+    std::vector<DockerRequest> requests(paths.size());
+    CURLcode status = CURLE_OK;
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    param.Accept(writer);
+    for (unsigned int i = 0; i < paths.size(); i++) {
+        requests[i].path = paths[i];
+        requests[i].body = buffer.GetString();
+    }
+    std::vector<DockerResponse> responses = performRequests(method_str, requests);
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        readBuffer += responses[i].data;
+        if (status == CURLE_OK) {
+            status = responses[i].result;
+        }
+    }
+    return status;
+}
+
+CURLcode Docker::request(Method method, const std::vector<std::string>& paths, JSON_DOC& param, std::string& readBuffer){
     std::string method_str;
 
     switch(method){
@@ -187,21 +370,14 @@ JSON_DOC Docker::requestAndParse(Method method, const std::vector<std::string>&
         default:
             method_str = "GET";
     }
-    long status = 0;
-    multiCurlRequests(readBuffer, paths, param, method_str);
+    return multiCurlRequests(readBuffer, paths, param, method_str);
+}
+
+JSON_DOC Docker::requestAndParse(Method method, const std::vector<std::string>& paths, JSON_DOC& param, long success_code){
+    std::string readBuffer;
+    long status = request(method, paths, param, readBuffer);
     const char* buf = readBuffer.c_str();
     JSON_DOC doc(rapidjson::kObjectType);
-    struct CURLMsg *m;
-    do {
-        int msgq = 0;
-        m = curl_multi_info_read(curlm, &msgq);
-        if (m && (m->msg == CURLMSG_DONE)) {
-            CURL *e = m->easy_handle;
-            status = (status == 0 || status == CURLE_OK)?m->data.result:status;
-            curl_multi_remove_handle(curlm, e);
-            curl_easy_cleanup(e);
-        }
-    } while(m);
     if(status == CURLE_OK){
         doc.AddMember("success", true, doc.GetAllocator());
 
@@ -221,23 +397,195 @@ JSON_DOC Docker::requestAndParse(Method method, const std::vector<std::string>&
     return doc;
 }
 
+// parses the response once, straight from the receive buffer
 JSON_DOC Docker::requestAndParseJson(Method method, const std::vector<std::string>& paths, JSON_DOC& param, long success_code){
-    JSON_DOC result_obj = requestAndParse(method,paths,param, success_code);
-    bool result = (result_obj.HasMember("success") && result_obj["success"].IsBool() && result_obj["success"].GetBool());
-    if(result){
-        JSON_DOC doc(rapidjson::kObjectType);
+    std::string readBuffer;
+    long status = request(method, paths, param, readBuffer);
+    JSON_DOC doc(rapidjson::kObjectType);
+    JSON_DOC data(&doc.GetAllocator());
+    data.Parse(readBuffer.c_str());
+    doc.AddMember("success", status == CURLE_OK, doc.GetAllocator());
+    if (status != CURLE_OK) {
+        doc.AddMember("code", status, doc.GetAllocator());
+    }
+    doc.AddMember("data", data, doc.GetAllocator());
+    return doc;
+}
 
-        JSON_DOC data(&doc.GetAllocator());
-        data.Parse(result_obj["data"].GetString());
+JsonFieldHandler::JsonFieldHandler(const std::vector<std::string>& paths)
+    : paths_(paths), depth_(0), ignored_(0), topArray_(false) {
+}
 
-        doc.AddMember("success", true, doc.GetAllocator());
-        doc.AddMember("data", data, doc.GetAllocator());
-        result_obj.SetNull();
-        result_obj.GetAllocator().Clear();
-        return doc;
-    }else{
-        return result_obj;
+bool JsonFieldHandler::rowLevel() const {
+    return depth_ == 0 || (depth_ == 1 && topArray_);
+}
+
+bool JsonFieldHandler::value(const std::string& v) {
+    if (ignored_ > 0 || rows.empty()) {
+        return true;
+    }
+    std::string path = prefixes_.empty() ? key_ : prefixes_.back() + "/" + key_;
+    for (unsigned int i = 0; i < paths_.size(); i++) {
+        if (paths_[i] == path) {
+            rows.back()[i] = v;
+            break;
+        }
+    }
+    return true;
+}
+
+bool JsonFieldHandler::StartObject() {
+    if (ignored_ > 0) {
+        ignored_++;
+    } else {
+        if (rowLevel()) {
+            rows.push_back(std::vector<std::string>(paths_.size()));
+        } else {
+            prefixes_.push_back(prefixes_.empty() ? key_ : prefixes_.back() + "/" + key_);
+        }
+        depth_++;
+    }
+    return true;
+}
+
+bool JsonFieldHandler::EndObject(rapidjson::SizeType) {
+    if (ignored_ > 0) {
+        ignored_--;
+    } else {
+        depth_--;
+        if (!rowLevel()) {
+            prefixes_.pop_back();
+        }
+    }
+    return true;
+}
+
+bool JsonFieldHandler::StartArray() {
+    if (ignored_ > 0 || depth_ > 0) {
+        // fields inside arrays cannot be picked
+        ignored_++;
+    } else {
+        topArray_ = true;
+        depth_++;
+    }
+    return true;
+}
+
+bool JsonFieldHandler::EndArray(rapidjson::SizeType) {
+    if (ignored_ > 0) {
+        ignored_--;
+    } else {
+        depth_--;
+    }
+    return true;
+}
+
+/*
+ * Pick the fields at paths out of json without building a DOM: one row per
+ * object of a top level array, or a single row for a top level object. A
+ * field missing from an object is left empty. Returns -1 if json is invalid.
+ */
+int parseJsonFields(const std::string& json, const std::vector<std::string>& paths, std::vector<std::vector<std::string>>& rows) {
+    JsonFieldHandler handler(paths);
+    rapidjson::Reader reader;
+    rapidjson::StringStream stream(json.c_str());
+    rapidjson::ParseResult ok = reader.Parse(stream, handler);
+    rows.swap(handler.rows);
+    return ok ? 0 : -1;
+}
+
+DockerEventStream::DockerEventStream() : host_uri("http:/v1.40"), curlm(nullptr), curl(nullptr){
+    curl_init_once();
+}
+
+DockerEventStream::~DockerEventStream(){
+    close();
+}
+
+/*
+ * Subscribe to the events matching filters, since is a unix timestamp to
+ * replay the events missed while not connected. Returns -1 if docker cannot
+ * be reached.
+ */
+int DockerEventStream::open(JSON_DOC& filters, long since){
+    int running = 0;
+
+    close();
+    std::string path = "/events?";
+    if (since > 0) {
+        path += param("since", std::to_string(since));
+    }
+    path += param("filters", filters);
+
+    curlm = curl_multi_init();
+    curl = curl_easy_init();
+    if (!curlm || !curl) {
+        close();
+        return -1;
+    }
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, "/var/run/docker.sock");
+    curl_easy_setopt(curl, CURLOPT_URL, (host_uri + path).c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+    curl_multi_add_handle(curlm, curl);
+
+    // connecting to the unix socket does not block, the request goes out now
+    if (curl_multi_perform(curlm, &running) != CURLM_OK || running == 0 || socket() < 0) {
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+void DockerEventStream::close(){
+    if (curl != nullptr) {
+        if (curlm != nullptr) {
+            curl_multi_remove_handle(curlm, curl);
+        }
+        curl_easy_cleanup(curl);
+        curl = nullptr;
+    }
+    if (curlm != nullptr) {
+        curl_multi_cleanup(curlm);
+        curlm = nullptr;
+    }
+    readBuffer.clear();
+}
+
+/*
+ * Append the events received so far to events. Returns -1 once the stream is
+ * closed, e.g. by a docker restart, the caller has to open it again.
+ */
+int DockerEventStream::read(std::vector<std::string>& events){
+    int running = 0;
+    size_t pos;
+
+    if (curlm == nullptr) {
+        return -1;
+    }
+    if (curl_multi_perform(curlm, &running) != CURLM_OK) {
+        running = 0;
+    }
+    while ((pos = readBuffer.find('\n')) != std::string::npos) {
+        if (pos > 0) {
+            events.push_back(readBuffer.substr(0, pos));
+        }
+        readBuffer.erase(0, pos + 1);
+    }
+    if (running == 0) {
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+int DockerEventStream::socket() const{
+    curl_socket_t sock = CURL_SOCKET_BAD;
+
+    if (curl == nullptr || curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sock) != CURLE_OK) {
+        return -1;
     }
+    return sock == CURL_SOCKET_BAD ? -1 : (int) sock;
 }
 
 /*
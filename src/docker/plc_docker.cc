@@ -1,5 +1,7 @@
 extern "C" {
+    #include "postgres.h"
     #include "plc/runtime_config.h"
+    #include "plc/plc_configuration.h"
     #include "common/comm_connectivity.h"
     #include "plc/plc_coordinator.h"
 }
@@ -24,24 +26,58 @@ int PlcDocker_start(const char *id, char *msg) {
     return res;
 }
 int PlcDocker_delete(const char** ids, int length, char *msg) {
-    std::vector<std::string> container_ids(length-1);
+    std::vector<std::string> container_ids;
     for (int i = 0; i < length; i++) {
-        container_ids.push_back(std::string(ids[i]));
+        if (ids[i] != NULL && ids[i][0] != '\0') {
+            container_ids.push_back(std::string(ids[i]));
+        }
     }
     std::string remove_res;
     int res = PlcDocker::remove(container_ids, remove_res);
     if (res < 0) {
-        strncpy(msg, remove_res.c_str(), DEFAULT_STRING_BUFFER_SIZE);
+        snprintf(msg, DEFAULT_STRING_BUFFER_SIZE, "%s", remove_res.c_str());
     }
     return res;
 }
-int PlcDocker_inspect(ContainerEntry** entries, int length) {
-    std::vector<std::string> container_ids(length);
-    std::vector<std::string> status(length);
+
+/*
+ * exited[i] is 1 if container i exited or is gone, 0 if it is still there
+ * and -1 if it cannot be inspected. Returns the number of the latter.
+ */
+int PlcDocker_inspect_exited(const char **ids, int length, int *exited) {
+    std::vector<std::string> container_ids;
+    std::vector<std::string> status;
     for (int i = 0; i < length; i++) {
-        container_ids.push_back(std::string(entries[i]->containerId));
+        container_ids.push_back(std::string(ids[i]));
+    }
+    int failed = PlcDocker::inspect_status(container_ids, status);
+    for (int i = 0; i < length; i++) {
+        if (status[i].empty()) {
+            exited[i] = -1;
+        } else {
+            exited[i] = (status[i] == "exited" || status[i] == "dead" || status[i] == "unexist") ? 1 : 0;
+        }
     }
-    return PlcDocker::inspect_status(container_ids,status);
+    return failed;
+}
+
+/*
+ * The PL/Container containers of segment dbid, palloc'd into *containers.
+ * Returns their number, or -1 if docker cannot list them.
+ */
+int PlcDocker_list(int dbid, containerStatus **containers) {
+    std::vector<std::vector<std::string>> rows;
+    if (PlcDocker::list(dbid, rows) < 0) {
+        return -1;
+    }
+    *containers = (containerStatus *) palloc0(sizeof(containerStatus) * (rows.size() + 1));
+    for (unsigned int i = 0; i < rows.size(); i++) {
+        (*containers)[i].idStr = pstrdup(rows[i][0].c_str());
+        (*containers)[i].statusStr = pstrdup(rows[i][1].c_str());
+        (*containers)[i].ownerStr = pstrdup(rows[i][2].c_str());
+        (*containers)[i].dbidStr = pstrdup(rows[i][3].c_str());
+    }
+    return (int) rows.size();
 }
 
 int PlcDocker_stat(const char** ids, int length, int64_t *mem_usage) {
@@ -61,6 +97,72 @@ int PlcDocker_stat(const char** ids, int length, int64_t *mem_usage) {
     }
     return res;
 }
+static DockerEventStream container_events;
+
+/*
+ * Subscribe to the die and destroy events of the containers of segment dbid,
+ * lets the coordinator aux process track containers without polling each of
+ * them. Returns the socket to wait on for new events, or -1.
+ */
+int PlcDocker_events_open(int dbid, long since) {
+    JSON_DOC filters(rapidjson::kObjectType);
+    JSON_VAL type(rapidjson::kArrayType);
+    JSON_VAL event(rapidjson::kArrayType);
+    JSON_VAL label(rapidjson::kArrayType);
+    std::string dbid_label = "dbid=" + std::to_string(dbid);
+
+    type.PushBack("container", filters.GetAllocator());
+    event.PushBack("die", filters.GetAllocator());
+    event.PushBack("destroy", filters.GetAllocator());
+    label.PushBack("plcontainer=true", filters.GetAllocator());
+    label.PushBack(JSON_VAL(dbid_label, filters.GetAllocator()), filters.GetAllocator());
+    filters.AddMember("type", type, filters.GetAllocator());
+    filters.AddMember("event", event, filters.GetAllocator());
+    filters.AddMember("label", label, filters.GetAllocator());
+    if (container_events.open(filters, since) < 0) {
+        return -1;
+    }
+    return container_events.socket();
+}
+
+/*
+ * Fill events with up to max_events events received since the last call.
+ * Returns their number, or -1 if the stream is closed and has to be opened
+ * again. Events beyond max_events stay for the next call.
+ */
+int PlcDocker_events_read(ContainerEvent *events, int max_events) {
+    static std::vector<std::string> lines;
+    int count = 0;
+    int res = 0;
+
+    if (lines.empty()) {
+        res = container_events.read(lines);
+    }
+    while (!lines.empty() && count < max_events) {
+        JSON_DOC event;
+        event.Parse(lines.front());
+        lines.erase(lines.begin());
+        if (event.HasParseError() || !event.IsObject() || !event.HasMember("Action") || !event["Action"].IsString() ||
+            !event.HasMember("Actor") || !event["Actor"].IsObject() ||
+            !event["Actor"].HasMember("ID") || !event["Actor"]["ID"].IsString()) {
+            continue;
+        }
+        ContainerEvent *ev = &events[count];
+        memset(ev, 0, sizeof(ContainerEvent));
+        snprintf(ev->containerId, sizeof(ev->containerId), "%s", event["Actor"]["ID"].GetString());
+        ev->destroyed = strcmp(event["Action"].GetString(), "destroy") == 0;
+        count++;
+    }
+    if (count == 0 && res < 0) {
+        return -1;
+    }
+    return count;
+}
+
+void PlcDocker_events_close(void) {
+    container_events.close();
+}
+
 JSON_VAL PlcDocker::get_volumes(JSON_DOC& param, runtimeConfEntry *conf, std::string uds_dir, bool& has_error) {
     JSON_VAL volumes(rapidjson::kArrayType);
 	has_error = false;
@@ -93,6 +195,16 @@ JSON_VAL PlcDocker::get_volumes(JSON_DOC& param, runtimeConfEntry *conf, std::st
 }
 std::string PlcDocker::create(runtimeConfEntry *conf, std::string uds_dir,int qe_pid, int session_id, int ccnt, int uid, int gid,int procid, int dbid, std::string ownername) {
     JSON_DOC param(rapidjson::kObjectType);
+    PlcDocker::create_param(param, conf, uds_dir, qe_pid, session_id, ccnt, uid, gid, procid, dbid, ownername);
+    return PlcDocker::create(param);
+}
+
+/*
+ * Fill the body of a create request. Everything taken from conf is copied into
+ * param, so the request can be sent after conf is gone.
+ */
+void PlcDocker::create_param(JSON_DOC& param, runtimeConfEntry *conf, std::string uds_dir,int qe_pid, int session_id, int ccnt, int uid, int gid,int procid, int dbid, std::string ownername) {
+    param.SetObject();
     JSON_VAL commands(rapidjson::kArrayType);
     JSON_VAL host_config(rapidjson::kObjectType);
     bool has_error = false;
@@ -144,7 +256,17 @@ std::string PlcDocker::create(runtimeConfEntry *conf, std::string uds_dir,int qe
     labels.AddMember("dbid", std::to_string(dbid), param.GetAllocator());
     labels.AddMember("owner", ownername, param.GetAllocator());
     param.AddMember("Labels", labels, param.GetAllocator());
-    Docker client = Docker();
+}
+
+// one client per thread, kept for the life of the thread
+Docker& PlcDocker::client() {
+    static thread_local Docker docker;
+    return docker;
+}
+
+// safe to call from any thread
+std::string PlcDocker::create(JSON_DOC& param) {
+    Docker& client = PlcDocker::client();
     JSON_DOC res = client.create_container(param);
     std::string container_id;
     if (res.HasMember("success") && res["success"].IsBool() && res["success"].GetBool()) {
@@ -159,7 +281,7 @@ std::string PlcDocker::create(runtimeConfEntry *conf, std::string uds_dir,int qe
 
 
 int PlcDocker::start(std::string id, std::string& result) {
-    Docker client = Docker();
+    Docker& client = PlcDocker::client();
     JSON_DOC res = client.start_container(id);
     if (res["success"] == true && res["data"].IsString()) {
         if (res["data"].GetStringLength() == 0) {
@@ -172,54 +294,172 @@ int PlcDocker::start(std::string id, std::string& result) {
         result = jsonToString(res);
         return -1;
     }
+    return -1;
+}
+
+// the message of a failed request, empty if the request succeeded
+static std::string response_error(const DockerResponse& response, long success_code, long ok_code = 0) {
+    if (response.result != CURLE_OK) {
+        return std::string(curl_easy_strerror(response.result));
+    }
+    if (response.code == success_code || (ok_code != 0 && response.code == ok_code)) {
+        return std::string();
+    }
+    JSON_DOC doc;
+    doc.Parse(response.data);
+    if (!doc.HasParseError() && doc.IsObject() && doc.HasMember("message") && doc["message"].IsString()) {
+        return std::string(doc["message"].GetString());
+    }
+    return "docker returns http code " + std::to_string(response.code);
+}
+
+/*
+ * The batched operations below send one request per container at once and
+ * report per container: an empty id or message means success.
+ */
+std::vector<std::string> PlcDocker::create(std::vector<JSON_DOC>& params) {
+    std::vector<std::string> bodies;
+    std::vector<std::string> ids(params.size());
+    std::vector<std::string> paths(1, "Id");
+    for (unsigned int i = 0; i < params.size(); i++) {
+        bodies.push_back(jsonToString(params[i]));
+        params[i].SetNull();
+        params[i].GetAllocator().Clear();
+    }
+    std::vector<DockerResponse> responses = PlcDocker::client().create_containers(bodies);
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        std::vector<std::vector<std::string>> rows;
+        if (response_error(responses[i], 201).empty() &&
+            parseJsonFields(responses[i].data, paths, rows) == 0 && !rows.empty()) {
+            ids[i] = rows[0][0];
+        }
+    }
+    return ids;
+}
+
+int PlcDocker::start(const std::vector<std::string>& ids, std::vector<std::string>& results) {
+    int failed = 0;
+    std::vector<DockerResponse> responses = PlcDocker::client().start_containers(ids);
+    results.resize(responses.size());
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        // 304: already started
+        results[i] = response_error(responses[i], 204, 304);
+        if (!results[i].empty()) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+int PlcDocker::stop(const std::vector<std::string>& ids, std::vector<std::string>& results) {
+    int failed = 0;
+    std::vector<DockerResponse> responses = PlcDocker::client().stop_containers(ids);
+    results.resize(responses.size());
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        // 304: already stopped
+        results[i] = response_error(responses[i], 204, 304);
+        if (!results[i].empty()) {
+            failed++;
+        }
+    }
+    return failed;
+}
+
+int PlcDocker::remove(const std::vector<std::string>& ids, std::vector<std::string>& results) {
+    int failed = 0;
+    std::vector<DockerResponse> responses = PlcDocker::client().remove_containers(ids);
+    results.resize(responses.size());
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        // 404: already gone
+        results[i] = response_error(responses[i], 204, 404);
+        if (!results[i].empty()) {
+            failed++;
+        }
+    }
+    return failed;
 }
 
 int PlcDocker::remove(std::vector<std::string>& ids, std::string& result) {
-    Docker client = Docker();
-    JSON_DOC res = client.delete_containers(ids);
-    if (res["data"].IsString() && res["data"].GetStringLength() > 0) {
-        result = res["data"].GetString();
-        return -1;
+    std::vector<std::string> results;
+    if (PlcDocker::remove(ids, results) == 0) {
+        return 0;
     }
-    return 0;
+    for (unsigned int i = 0; i < results.size(); i++) {
+        if (!results[i].empty()) {
+            result = ids[i] + ": " + results[i];
+            break;
+        }
+    }
+    return -1;
 }
 
+/*
+ * State.Status of each container, "unexist" if there is no such container
+ * and empty if it cannot be inspected. Returns the number of the latter.
+ */
 int PlcDocker::inspect_status(std::vector<std::string>& ids, std::vector<std::string>& status) {
-    Docker client = Docker();
-    JSON_DOC res = client.inspect_containers(ids);
-    return 0;
+    std::vector<std::string> paths(1, "State/Status");
+    int failed = 0;
+    std::vector<DockerResponse> responses = PlcDocker::client().inspect_each_container(ids);
+    status.assign(responses.size(), std::string());
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        if (responses[i].result == CURLE_OK && responses[i].code == 404) {
+            status[i] = "unexist";
+            continue;
+        }
+        std::vector<std::vector<std::string>> rows;
+        if (response_error(responses[i], 200).empty() &&
+            parseJsonFields(responses[i].data, paths, rows) == 0 && !rows.empty()) {
+            status[i] = rows[0][0];
+        }
+        if (status[i].empty()) {
+            failed++;
+        }
+    }
+    return failed;
 }
 
+/*
+ * Memory usage of each container, 0 if it has none. Returns 1, or -1 if no
+ * container could be asked.
+ */
 int PlcDocker::mem_stats(std::vector<std::string>& ids, std::vector<std::int64_t>& mem_usage) {
-    Docker client = Docker();
-    JSON_DOC res = client.stat_containers(ids);
-    if (res["success"] == true && res["data"].IsString()) {
-        if (res["data"].GetStringLength() == 0) {
-            return 0;
-        } else {
-            std::string stat_string = res["data"].GetString();
-            std::string delimiter = "\n";
-            JSON_DOC stat;
-            size_t pos = 0;
-            std::string token;
-            while ((pos = stat_string.find(delimiter)) != std::string::npos) {
-                token = stat_string.substr(0, pos);
-                if (token.length() <= 0) {
-                    break;
-                }
-                stat.Parse(token);
-                if (stat.HasMember("memory_stats") && stat["memory_stats"].IsObject() == true) {
-                    if (stat["memory_stats"].HasMember("usage") && stat["memory_stats"]["usage"].IsInt64() == true) {
-                        mem_usage.push_back(stat["memory_stats"]["usage"].GetInt64());
-                    }
-                } else {
-                    mem_usage.push_back(0);
-                }
-                stat_string.erase(0, pos + delimiter.length());
-            }
-            return 1;
+    std::vector<std::string> paths(1, "memory_stats/usage");
+    int failed = 0;
+    if (ids.empty()) {
+        return 0;
+    }
+    std::vector<DockerResponse> responses = PlcDocker::client().stat_each_container(ids);
+    mem_usage.assign(responses.size(), 0);
+    for (unsigned int i = 0; i < responses.size(); i++) {
+        std::vector<std::vector<std::string>> rows;
+        if (!response_error(responses[i], 200).empty()) {
+            failed++;
+            continue;
         }
-    } else if (res["success"] == false) {
+        if (parseJsonFields(responses[i].data, paths, rows) == 0 && !rows.empty() && !rows[0][0].empty()) {
+            mem_usage[i] = std::strtoll(rows[0][0].c_str(), nullptr, 10);
+        }
+    }
+    return failed == (int) responses.size() ? -1 : 1;
+}
+
+/*
+ * Id, status, owner and dbid of the PL/Container containers of segment dbid,
+ * picked from the list response without building a DOM.
+ */
+int PlcDocker::list(int dbid, std::vector<std::vector<std::string>>& containers) {
+    JSON_DOC filters(rapidjson::kObjectType);
+    JSON_VAL label(rapidjson::kArrayType);
+    std::string dbid_label = "dbid=" + std::to_string(dbid);
+    std::vector<std::string> paths = {"Id", "Status", "Labels/owner", "Labels/dbid"};
+
+    label.PushBack("plcontainer=true", filters.GetAllocator());
+    label.PushBack(JSON_VAL(dbid_label, filters.GetAllocator()), filters.GetAllocator());
+    filters.AddMember("label", label, filters.GetAllocator());
+    DockerResponse response = PlcDocker::client().list_containers_raw(filters);
+    if (!response_error(response, 200).empty()) {
         return -1;
     }
-}
\ No newline at end of file
+    return parseJsonFields(response.data, paths, containers);
+}
@@ -15,62 +15,172 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include "lib/ilist.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
 #include "plc/message_fns.h"
 
-static plcProcInfo *plcFunctionCache[PLC_FUNCTION_CACHE_SIZE];
-static int plcFunctionCacheInitialized = 0;
+/* A catalog row the cached information was built from */
+typedef struct plcFunctionCacheDep {
+	int cacheId;             /* TYPEOID or RELOID */
+	uint32 hashValue;        /* syscache hash value of the row */
+} plcFunctionCacheDep;
+
+typedef struct plcFunctionCacheEntry {
+	Oid funcOid;             /* hash key, must be first */
+	uint32 hashValue;        /* PROCOID syscache hash value of funcOid */
+	bool valid;              /* cleared when a row it depends on changes */
+	plcProcInfo *proc;
+	plcFunctionCacheDep *deps;  /* types of the arguments and the result */
+	int nDeps;
+	int maxDeps;
+	dlist_node lruNode;      /* most recently used entry first */
+} plcFunctionCacheEntry;
+
+static HTAB *plcFunctionCache = NULL;
+static dlist_head plcFunctionCacheLRU = DLIST_STATIC_INIT(plcFunctionCacheLRU);
+
+static void function_cache_init(void);
+static void function_cache_evict(plcFunctionCacheEntry *entry);
+static void function_cache_add_dep(plcFunctionCacheEntry *entry, int cacheId, Oid objectId);
+static void function_cache_add_type_deps(plcFunctionCacheEntry *entry, plcTypeInfo *type);
+static void function_cache_callback(Datum arg, int cacheid, uint32 hashvalue);
+
+static void function_cache_init(void) {
+	HASHCTL hash_ctl;
 
-/* Move up the cache item */
-void function_cache_up(int index) {
-	plcProcInfo *tmp;
+	memset(&hash_ctl, 0, sizeof(hash_ctl));
+	hash_ctl.keysize = sizeof(Oid);
+	hash_ctl.entrysize = sizeof(plcFunctionCacheEntry);
+	hash_ctl.hash = oid_hash;
+	hash_ctl.hcxt = TopMemoryContext;
+	plcFunctionCache = hash_create("PL/Container function cache",
+								   64,
+								   &hash_ctl,
+								   HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	CacheRegisterSyscacheCallback(PROCOID, function_cache_callback, (Datum) 0);
+	CacheRegisterSyscacheCallback(TYPEOID, function_cache_callback, (Datum) 0);
+	CacheRegisterSyscacheCallback(RELOID, function_cache_callback, (Datum) 0);
+}
+
+/*
+ * Entries are only marked here, they are rebuilt by the next call of the
+ * function since an invalidation may arrive while the function is running.
+ * A hash value of 0 means the whole syscache was reset.
+ */
+static void function_cache_callback(pg_attribute_unused() Datum arg,
+                                    int cacheid,
+                                    uint32 hashvalue) {
+	dlist_iter iter;
 	int i;
-	if (index > 0) {
-		tmp = plcFunctionCache[index];
-		for (i = index; i > 0; i--) {
-			plcFunctionCache[i] = plcFunctionCache[i - 1];
+
+	dlist_foreach(iter, &plcFunctionCacheLRU) {
+		plcFunctionCacheEntry *entry = dlist_container(plcFunctionCacheEntry, lruNode, iter.cur);
+
+		if (!entry->valid) {
+			continue;
+		}
+		if (cacheid == PROCOID) {
+			entry->valid = (hashvalue != 0 && entry->hashValue != hashvalue);
+			continue;
+		}
+		for (i = 0; i < entry->nDeps; i++) {
+			if (entry->deps[i].cacheId == cacheid &&
+			    (hashvalue == 0 || entry->deps[i].hashValue == hashvalue)) {
+				entry->valid = false;
+				break;
+			}
 		}
-		plcFunctionCache[0] = tmp;
 	}
 }
 
-plcProcInfo *function_cache_get(Oid funcOid) {
+static void function_cache_add_dep(plcFunctionCacheEntry *entry, int cacheId, Oid objectId) {
+	if (entry->nDeps == entry->maxDeps) {
+		entry->maxDeps *= 2;
+		entry->deps = repalloc(entry->deps, entry->maxDeps * sizeof(plcFunctionCacheDep));
+	}
+	entry->deps[entry->nDeps].cacheId = cacheId;
+	entry->deps[entry->nDeps].hashValue = GetSysCacheHashValue1(cacheId, ObjectIdGetDatum(objectId));
+	entry->nDeps++;
+}
+
+/*
+ * Composite types are tracked through their pg_class row as well, which is
+ * what changes when attributes are added, dropped or altered. Records only
+ * change together with the function itself.
+ */
+static void function_cache_add_type_deps(plcFunctionCacheEntry *entry, plcTypeInfo *type) {
 	int i;
-	plcProcInfo *resFunc = NULL;
-	/* Initialize all the elements with nulls initially */
-	if (!plcFunctionCacheInitialized) {
-		for (i = 0; i < PLC_FUNCTION_CACHE_SIZE; i++) {
-			plcFunctionCache[i] = NULL;
-		}
-		plcFunctionCacheInitialized = 1;
+
+	if (OidIsValid(type->typeOid)) {
+		function_cache_add_dep(entry, TYPEOID, type->typeOid);
 	}
-	for (i = 0; i < PLC_FUNCTION_CACHE_SIZE; i++) {
-		if (plcFunctionCache[i] != NULL &&
-		    plcFunctionCache[i]->funcOid == funcOid) {
-			resFunc = plcFunctionCache[i];
-			function_cache_up(i);
-			break;
-		}
+	if (type->is_rowtype && !type->is_record && OidIsValid(type->typ_relid)) {
+		function_cache_add_dep(entry, RELOID, type->typ_relid);
+	}
+	for (i = 0; i < type->nSubTypes; i++) {
+		function_cache_add_type_deps(entry, &type->subTypes[i]);
 	}
-	return resFunc;
+}
+
+static void function_cache_evict(plcFunctionCacheEntry *entry) {
+	free_proc_info(entry->proc);
+	pfree(entry->deps);
+	dlist_delete(&entry->lruNode);
+	hash_search(plcFunctionCache, &entry->funcOid, HASH_REMOVE, NULL);
+}
+
+plcProcInfo *function_cache_get(Oid funcOid) {
+	plcFunctionCacheEntry *entry;
+
+	if (plcFunctionCache == NULL) {
+		function_cache_init();
+	}
+
+	entry = (plcFunctionCacheEntry *) hash_search(plcFunctionCache, &funcOid, HASH_FIND, NULL);
+	if (entry == NULL || !entry->valid) {
+		return NULL;
+	}
+	dlist_move_head(&plcFunctionCacheLRU, &entry->lruNode);
+	return entry->proc;
 }
 
 void function_cache_put(plcProcInfo *func) {
+	plcFunctionCacheEntry *entry;
+	bool found;
 	int i;
-	plcProcInfo *oldFunc;
-	oldFunc = function_cache_get(func->funcOid);
-	/* If the function is not cached already */
-	if (oldFunc == NULL) {
-		/* If the last element exists we need to free its memory */
-		if (plcFunctionCache[PLC_FUNCTION_CACHE_SIZE - 1] != NULL) {
-			free_proc_info(plcFunctionCache[PLC_FUNCTION_CACHE_SIZE - 1]);
-		}
-		/* Move our LRU cache right */
-		for (i = PLC_FUNCTION_CACHE_SIZE - 1; i > 0; i--) {
-			plcFunctionCache[i] = plcFunctionCache[i - 1];
+
+	if (plcFunctionCache == NULL) {
+		function_cache_init();
+	}
+
+	entry = (plcFunctionCacheEntry *) hash_search(plcFunctionCache, &func->funcOid, HASH_ENTER, &found);
+	if (found) {
+		if (entry->proc != func) {
+			free_proc_info(entry->proc);
 		}
-		plcFunctionCache[0] = func;
+		dlist_delete(&entry->lruNode);
 	} else {
-		free_proc_info(oldFunc);
-		plcFunctionCache[0] = func;
+		entry->hashValue = GetSysCacheHashValue1(PROCOID, ObjectIdGetDatum(func->funcOid));
+		entry->maxDeps = func->nargs + 1;
+		entry->deps = MemoryContextAlloc(TopMemoryContext, entry->maxDeps * sizeof(plcFunctionCacheDep));
+	}
+	entry->proc = func;
+	entry->nDeps = 0;
+	function_cache_add_type_deps(entry, &func->result);
+	for (i = 0; i < func->nargs; i++) {
+		function_cache_add_type_deps(entry, &func->args[i]);
+	}
+	entry->valid = true;
+	dlist_push_head(&plcFunctionCacheLRU, &entry->lruNode);
+
+	/* Drop the least recently used functions beyond the configured capacity */
+	while (hash_get_num_entries(plcFunctionCache) > plc_function_cache_size) {
+		entry = dlist_tail_element(plcFunctionCacheEntry, lruNode, &plcFunctionCacheLRU);
+		function_cache_evict(entry);
 	}
 }
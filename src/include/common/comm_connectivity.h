@@ -38,6 +38,9 @@ typedef struct plcContext
 {
 	char *service_address; /* File for unix domain socket connection only. */
     char *container_id;
+    int command_count;  /* the container is known to the coordinator by it */
+    uint32_t generation; /* runtime configuration the container runs with */
+    char *owner;        /* the user the container was started for */
     plcContextStage stages[MAX_PLC_CONTEXT_STAGE_NUM];
     int current_stage_num;
     int max_stage_num;
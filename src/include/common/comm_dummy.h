@@ -39,6 +39,20 @@ extern void *txn_palloc(size_t size);
 
 extern void plc_elog(int log_level, const char *format, ...);
 
+#ifndef PLC_SERVER
+extern bool plc_log_enabled(int log_level);
+
+/*
+ * Like plc_elog(), but the arguments are only evaluated when the message
+ * is going to be emitted, meant for costly arguments such as payload dumps.
+ */
+#define plc_elog_lazy(log_level, ...) \
+	do { \
+		if (plc_log_enabled(log_level)) \
+			plc_elog(log_level, __VA_ARGS__); \
+	} while (0)
+#endif
+
 //void deinit_pplan_slots(plcContext *ctx);
 //void init_pplan_slots(plcContext *ctx);
 
@@ -9,9 +9,8 @@
 #ifndef _CO_SHM_H
 #define _CO_SHM_H
 
-#include "storage/dsm.h"
-#include "storage/shm_mq.h"
-#include "storage/spin.h"
+#include "storage/latch.h"
+#include "storage/lwlock.h"
 
 #define CO_SHM_KEY  "plcoordinator_shm"
 
@@ -24,8 +23,6 @@ typedef enum CoordinatorState {
     CO_STATE_UNINITIALIZED = 1,
     CO_STATE_READY,
     CO_STATE_EXITING,
-	CO_STATE_BUFFER_INITIALIZED,
-	CO_STATE_BUFFER_ATTACHED,
 } CoordinatorState;
 
 typedef enum CoordinatorProtocol {
@@ -39,6 +36,7 @@ typedef struct CoordinatorStruct
     volatile CoordinatorState state;
     CoordinatorProtocol protocol;
     char address[504];
+    LWLock *registryLock;   /* for container_status_table */
 } CoordinatorStruct;
 
 typedef struct requester_info_entry
@@ -87,20 +85,30 @@ typedef struct QeRequest
 	pid_t server_pid; /* SERVER PID */
 } QeRequest;
 
-typedef struct ShmqBufferStatus
+/*
+ * Bounded multi-producer ring of QeRequests read by the aux process. A slot
+ * is free for the producer that claimed position pos when its sequence is
+ * pos, and holds a request for the consumer once it is pos + 1. Producers
+ * claim positions with a compare-and-swap on head, only the aux process
+ * moves tail, so sending never takes a lock nor waits for the consumer.
+ */
+typedef struct QeRequestSlot
 {
-	slock_t mutex;
-	CoordinatorState state;
-} ShmqBufferStatus;
+	uint64 sequence;
+	QeRequest request;
+} QeRequestSlot;
 
-typedef struct CoordinatorConstraint
+typedef struct QeRequestRing
 {
-	slock_t mutex;
-	int dockerCreating;
-} CoordinatorConstraint;
-
-#define	PLC_COORDINATOR_MAGIC_NUMBER 0x666fff88
-#define SHMQ_BUFFER_BLOCK_NUMBER 10000
+	uint64 head;	/* next position claimed by a producer */
+	uint64 tail;	/* next position read by the aux process */
+	Latch *consumer;	/* latch of the aux process, NULL until it runs */
+	QeRequestSlot slots[FLEXIBLE_ARRAY_MEMBER];
+} QeRequestRing;
+
+#define QE_REQUEST_RING_KEY "plcoordinator_request_ring"
+/* must be a power of 2 */
+#define QE_REQUEST_RING_SIZE 16384
 
 /* For debug use only */
 extern bool plcontainer_debug_mode;
@@ -9,6 +9,7 @@
 #include <curl/curl.h>
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
+#include "rapidjson/reader.h"
 
 #define JSON_DOC rapidjson::Document
 #define JSON_VAL rapidjson::Value
@@ -28,11 +29,67 @@ std::string param( const std::string& param_name, JSON_DOC& param_value);
 
 std::string jsonToString(JSON_VAL & doc);
 
+/*
+ * SAX handler for parseJsonFields(), keeps the scalar fields it is asked for
+ * and nothing else.
+ */
+class JsonFieldHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, JsonFieldHandler>{
+    public :
+        explicit JsonFieldHandler(const std::vector<std::string>& paths);
+
+        bool Null() { return value(std::string()); }
+        bool Bool(bool b) { return value(b ? "true" : "false"); }
+        bool Int(int i) { return value(std::to_string(i)); }
+        bool Uint(unsigned u) { return value(std::to_string(u)); }
+        bool Int64(int64_t i) { return value(std::to_string(i)); }
+        bool Uint64(uint64_t u) { return value(std::to_string(u)); }
+        bool Double(double d) { return value(std::to_string(d)); }
+        bool String(const char* str, rapidjson::SizeType length, bool) { return value(std::string(str, length)); }
+        bool Key(const char* str, rapidjson::SizeType length, bool) { key_.assign(str, length); return true; }
+        bool StartObject();
+        bool EndObject(rapidjson::SizeType);
+        bool StartArray();
+        bool EndArray(rapidjson::SizeType);
+
+        std::vector<std::vector<std::string>> rows;
+    private:
+        bool value(const std::string& v);
+        bool rowLevel() const;
+
+        std::vector<std::string> paths_;
+        std::vector<std::string> prefixes_;
+        std::string key_;
+        int depth_;
+        int ignored_;
+        bool topArray_;
+};
+
+int parseJsonFields(const std::string& json, const std::vector<std::string>& paths, std::vector<std::vector<std::string>>& rows);
+
+struct DockerRequest{
+    std::string path;
+    std::string body;
+};
+
+struct DockerResponse{
+    CURLcode result;    // of the transfer
+    long code;          // http status
+    std::string data;
+};
+
+/*
+ * A client keeps its curl handles between requests, and all clients of the
+ * process share one connection cache, so requests reuse the keep-alive
+ * connections to the docker socket. A client must only be used by one thread
+ * at a time, see PlcDocker::client().
+ */
 class Docker{
     public :
         Docker();
         explicit Docker(std::string host);
         ~Docker();
+        Docker(const Docker&) = delete;
+        Docker& operator=(const Docker&) = delete;
 
         /*
         * System
@@ -60,6 +117,14 @@ class Docker{
         JSON_DOC wait_container(const std::string& container_id);
         JSON_DOC delete_containers(const std::vector<std::string>& container_ids, bool v=true, bool force=true);
         JSON_DOC stat_containers(const std::vector<std::string>& container_ids, bool is_stream = false);
+
+        std::vector<DockerResponse> create_containers(const std::vector<std::string>& parameters);
+        std::vector<DockerResponse> start_containers(const std::vector<std::string>& container_ids);
+        std::vector<DockerResponse> stop_containers(const std::vector<std::string>& container_ids, int delay=-1);
+        std::vector<DockerResponse> remove_containers(const std::vector<std::string>& container_ids, bool v=true, bool force=true);
+        std::vector<DockerResponse> inspect_each_container(const std::vector<std::string>& container_ids);
+        std::vector<DockerResponse> stat_each_container(const std::vector<std::string>& container_ids);
+        DockerResponse list_containers_raw(JSON_DOC& filters, bool all=true);
     private:
         std::string host_uri;
         bool is_multi;
@@ -67,10 +132,45 @@ class Docker{
         CURLM *curlm{};
         CURLcode res{};
         int mActiveTransfers;
+        int mEpollFd;
+        long mTimeoutMs;
+        std::vector<CURL *> idleHandles;
 
+        CURLcode request(Method method, const std::vector<std::string>& paths, JSON_DOC& param, std::string& readBuffer);
         JSON_DOC requestAndParse(Method method, const std::vector<std::string>& paths, JSON_DOC& param, long success_code = 200);
         JSON_DOC requestAndParseJson(Method method, const std::vector<std::string>& path, JSON_DOC& param, long success_code = 200);
-        int multiCurlRequests(std::string& readBuffer, const std::vector<std::string>& paths, JSON_DOC& param, std::string method_str);
+        CURLcode multiCurlRequests(std::string& readBuffer, const std::vector<std::string>& paths, JSON_DOC& param, std::string method_str);
+        std::vector<DockerResponse> performRequests(const std::string& method_str, const std::vector<DockerRequest>& requests);
+        CURL *takeHandle();
+        void driveTransfers();
+        static int socketCallback(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp);
+        static int timerCallback(CURLM *multi, long timeout_ms, void *userp);
+        static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp){
+            ((std::string*)userp)->append((char*)contents, size * nmemb);
+            return size * nmemb;
+        }
+};
+
+/*
+ * The streaming /events endpoint, read without blocking. Docker sends one
+ * JSON object per line and keeps the connection open, Read() hands out the
+ * complete lines received so far.
+ */
+class DockerEventStream{
+    public :
+        DockerEventStream();
+        ~DockerEventStream();
+
+        int open(JSON_DOC& filters, long since=-1);
+        void close();
+        int read(std::vector<std::string>& events);
+        int socket() const;
+        bool is_open() const { return curl != nullptr; }
+    private:
+        std::string host_uri;
+        CURLM *curlm;
+        CURL *curl;
+        std::string readBuffer;
         static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp){
             ((std::string*)userp)->append((char*)contents, size * nmemb);
             return size * nmemb;
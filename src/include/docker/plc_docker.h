@@ -9,7 +9,12 @@ extern "C" {
 	int PlcDocker_create(runtimeConfEntry *conf, char **name, char *uds_dir, int qe_pid, int session_id, int ccnt, int uid, int gid,int procid, int dbid, char *ownername);
     int PlcDocker_start(const char *id, char *msg);
     int PlcDocker_delete(const char **ids, int length, char *msg);
+    int PlcDocker_inspect_exited(const char **ids, int length, int *exited);
     int PlcDocker_stat(const char** ids, int length, int64_t *mem_usage);
+    int PlcDocker_list(int dbid, containerStatus **containers);
+    int PlcDocker_events_open(int dbid, long since);
+    int PlcDocker_events_read(ContainerEvent *events, int max_events);
+    void PlcDocker_events_close(void);
 #if defined(__cplusplus)
 }
 #endif
@@ -18,10 +23,18 @@ extern "C" {
 class PlcDocker {
 public:
     static std::string create(runtimeConfEntry *conf, std::string uds_dir,int qe_pid, int session_id, int ccnt, int uid, int gid,int procid, int dbid, std::string ownername);
+    static void create_param(JSON_DOC& param, runtimeConfEntry *conf, std::string uds_dir,int qe_pid, int session_id, int ccnt, int uid, int gid,int procid, int dbid, std::string ownername);
+    static std::string create(JSON_DOC& param);
     static int start(std::string id, std::string& result);
     static int remove(std::vector<std::string>& ids, std::string& result);
+    static std::vector<std::string> create(std::vector<JSON_DOC>& params);
+    static int start(const std::vector<std::string>& ids, std::vector<std::string>& results);
+    static int stop(const std::vector<std::string>& ids, std::vector<std::string>& results);
+    static int remove(const std::vector<std::string>& ids, std::vector<std::string>& results);
     static int inspect_status(std::vector<std::string>& ids, std::vector<std::string>& status);
+    static int list(int dbid, std::vector<std::vector<std::string>>& containers);
     static int mem_stats(std::vector<std::string>& ids, std::vector<std::int64_t>& mem_usage);
+    static Docker& client();
     static JSON_VAL get_volumes(JSON_DOC& param, runtimeConfEntry *conf, std::string uds_dir, bool& has_error);
 };
 #endif //__PLC_DOCKER_H__
\ No newline at end of file
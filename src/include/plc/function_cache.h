@@ -11,9 +11,8 @@
 
 #include "plc/message_fns.h"
 
-#define PLC_FUNCTION_CACHE_SIZE 5
-
-void function_cache_up(int index);
+/* Max number of functions cached per backend, plcontainer.function_cache_size */
+extern int plc_function_cache_size;
 
 plcProcInfo *function_cache_get(Oid funcOid);
 
@@ -27,6 +27,8 @@ Datum refresh_plcontainer_config(PG_FUNCTION_ARGS);
 Datum show_plcontainer_config(PG_FUNCTION_ARGS);
 
 Datum containers_summary(PG_FUNCTION_ARGS);
+
+Datum containers_registry(PG_FUNCTION_ARGS);
 runtimeConfEntry *plc_get_runtime_configuration(const char *id);
 
 char* get_config_filename();
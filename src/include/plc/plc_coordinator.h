@@ -8,6 +8,12 @@
 #ifndef _CO_COORDINATOR_H
 #define _CO_COORDINATOR_H
 
+#include "utils/hsearch.h"
+#include "plc/runtime_config.h"
+
+/* a full docker container id, ids are compared as a whole */
+#define CONTAINER_ID_SIZE 65
+
 /* the container status key */
 typedef struct ContainerKey
 {
@@ -16,17 +22,45 @@ typedef struct ContainerKey
 	int 		ccnt;
 } ContainerKey;
 
-/* the container status entry */
+/*
+ * the container status entry, in shared memory so that backends and
+ * monitoring functions see the containers without asking the coordinator
+ */
 typedef struct ContainerEntry
 {
 	ContainerKey    key;		        /* hash key */
-	char            containerId[16];    /* for container */
+	char            containerId[CONTAINER_ID_SIZE];  /* for container */
 	pid_t           stand_alone_pid;    /* for stand alone mode */
-	char* 			status;
+	char            runtimeid[RUNTIME_ID_MAX_LENGTH];
+	char            owner[NAMEDATALEN];
 } ContainerEntry;
 
+/* a plcontainer container exited or was removed, see PlcDocker_events_read() */
+typedef struct ContainerEvent
+{
+	char            containerId[CONTAINER_ID_SIZE];  /* as in ContainerEntry */
+	bool            destroyed;          /* removed, otherwise just exited */
+} ContainerEvent;
+
 extern char *get_coordinator_address(void);
-extern int start_container(const char *runtimeid, pid_t qe_pid, int session_id, int ccnt, int dbid, const char *ownername, char **uds_address, char **container_id, char **log_msg);
+struct runtimeConfEntry;
+
+extern int plc_max_docker_creating_num;
+extern int plc_max_containers;
+extern bool plc_reuse_containers;
+extern int plc_max_reusable_containers;
+extern uint32 plc_runtime_config_generation;
+
+extern int prepare_container_start(const char *runtimeid, const char *owner, pid_t qe_pid, int session_id, int ccnt, char **uds_address, char **container_id, char **log_msg, struct runtimeConfEntry **runtime_entry, char **uds_dir);
+extern int finish_container_start(const char *runtimeid, const char *owner, pid_t qe_pid, int session_id, int ccnt, const char *container_id, int res);
+extern void finish_pool_container_start(const char *runtimeid, uint32 generation, const char *container_id, const char *uds_dir, int res);
+extern int prepare_container_release(const char *runtimeid, uint32 generation, pid_t qe_pid, int session_id, int ccnt, const char *container_id);
+extern void finish_container_release(const char *runtimeid, const char *owner, uint32 generation, const char *container_id, const char *uds_address, bool reset);
 extern int destroy_container(pid_t qe_pid, int session_id, int ccnt);
+extern bool lookup_container(pid_t qe_pid, int session_id, int ccnt, const char *container_id);
+extern int copy_container_registry(ContainerEntry **entries);
+
+/* the container registry, guarded by coordinator_shm->registryLock */
+extern HTAB *container_status_table;
 
 #endif /* _CO_COORDINATOR_H */
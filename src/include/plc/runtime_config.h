@@ -1,6 +1,7 @@
 #ifndef __RUNTIME_CONFIG_H__
 #define __RUNTIME_CONFIG_H__
 #define RUNTIME_ID_MAX_LENGTH 64
+#define PLC_MAX_POOL_SIZE 32
 typedef enum {
     PLC_ACCESS_READONLY = 0,
     PLC_ACCESS_READWRITE = 1
@@ -32,6 +33,7 @@ typedef struct runtimeConfEntry {
     int resgroupOid;
     int memoryMb;
     int cpuShare;
+    int poolSize;       /* started containers kept ready by the coordinator */
     int nSharedDirs;
     plcSharedDir *sharedDirs;
     bool useContainerNetwork;
@@ -1,11 +1,17 @@
 #ifndef __ASYNC_SERVER_H__
 #define __ASYNC_SERVER_H__
 
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 
+#include <sys/eventfd.h>
 #include <unistd.h>
 
+#include <grpcpp/alarm.h>
 #include <grpcpp/grpcpp.h>
 #include <grpc/support/log.h>
 #include "plcontainer.grpc.pb.h"
@@ -33,18 +39,37 @@ using grpc::Status;
 
 using namespace plcontainer;
 
+class ContainerStart;
+
 class AsyncServer final {
 public:
+    AsyncServer();
     ~AsyncServer();
 
     void Init(const std::string &uds);    
     void Start();
-    void ProcessRequest(int timeout_seconds);
+    void ProcessRequest();
+    int EventFd() const { return event_fd_; }
+
+    ContainerStart *NewPoolContainerStart(runtimeConfEntry *conf, const char *uds_dir, int dbid);
+    void ScheduleContainerStart(ContainerStart *call);
+    void ContainerStartDone();
 
 private:
+    void pollCompletionQueue();
+
     PLCoordinator::AsyncService service_;
     std::unique_ptr<Server> server_;
     std::unique_ptr<ServerCompletionQueue> cq_;
+
+    int creating_;
+    std::deque<ContainerStart *> waiting_;
+
+    // completion queue events handed from poller_ to the main thread
+    int event_fd_;
+    std::thread poller_;
+    std::mutex mutex_;
+    std::deque<std::pair<void *, bool>> events_;
 };
 
 #endif
@@ -5,7 +5,9 @@
 #include <unistd.h>
 
 #include <chrono>
+#include <deque>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <random>
 #include <string>
@@ -23,28 +25,105 @@
 extern "C"
 {
 #include "postgres.h"
+#include "access/xact.h"
 #include "mb/pg_wchar.h"
+#include "funcapi.h"
+#include "utils/memutils.h"
+#include "utils/tuplestore.h"
 #include "common/comm_dummy.h"
 #include "plc/containers.h"
 #include "plc/plc_coordinator.h"
 #include "cdb/cdbvars.h"
 
 extern int plc_client_timeout;
+extern int plc_batch_size;
+extern bool plc_packed_array;
+extern bool plc_lossless_numeric;
+extern int plc_max_inflight_calls;
+extern int plc_trace_payload_size;
+extern int plc_trace_payload_interval;
 }
 
 using namespace plcontainer;
 
 
+struct PLContainerChannel;
+
+// a batch sent asynchronously, waiting for its results
+struct PLContainerPendingCall {
+    const plcContext    *ctx;
+    std::shared_ptr<PLContainerChannel> channel;   // the call was sent on
+    grpc::ClientContext context;
+    BatchCallRequest    request;
+    BatchCallResponse   response;
+    grpc::Status        status;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<BatchCallResponse>> reader;
+    bool                done;
+    bool                readonly;   // the function is not volatile
+    SubTransactionId    subid;      // the rows were appended in
+};
+
+/*
+ * Arena holding the request and response messages of a call. Its first block
+ * is kept across calls, bigger messages spill into blocks palloc'd in a
+ * dedicated memory context, so the hot path does no malloc/free and an ERROR
+ * between Acquire() and Release() cannot leak message memory. Nested calls
+ * share the arena, it is reset when the outermost call releases it.
+ */
+class PLContainerArena {
+public:
+    static google::protobuf::Arena *Acquire();
+    static void Release();
+
+private:
+    static void *blockAlloc(size_t size);
+    static void blockDealloc(void *block, size_t size);
+
+    static google::protobuf::Arena *arena;
+    static MemoryContext context;
+    static int depth;
+};
+
+// a function registered on a runtime, valid as long as its pg_proc row is
+struct PLContainerFunction {
+    TransactionId   xmin;
+    uint64_t        handle;
+    RegisterFunctionRequest registration;
+};
+
+struct PLContainerChannel {
+    std::unique_ptr<PLContainer::Stub> stub;
+    // cleared once the runtime behind stub rejects FunctionCallStream
+    bool    streaming;
+    // cleared once the runtime behind stub rejects RegisterFunction
+    bool    registration;
+    std::map<Oid, PLContainerFunction> functions;
+};
+
 class PLContainerClient {
 public:
     static PLContainerClient *GetPLContainerClient();
 
     void Init(const plcContext *ctx);
+    void ReleaseChannel(const char *address);
 
-    void FunctionCall(const CallRequest &request, CallResponse &response);
+    void FunctionCall(CallRequest &request, CallResponse &response) { this->FunctionCall(this->channel_.get(), request, response); }
+    void FunctionCall(PLContainerChannel *channel, CallRequest &request, CallResponse &response);
+    void BatchFunctionCall(PLContainerChannel *channel, BatchCallRequest &request, BatchCallResponse &response, bool retry);
+    void AsyncBatchFunctionCall(grpc::CompletionQueue *cq, PLContainerPendingCall *call);
+    bool CheckBatchFunctionCall(PLContainerChannel *channel, const grpc::Status &status, BatchCallRequest &request, BatchCallResponse &response, bool *retry);
+    std::unique_ptr<grpc::ClientAsyncReader<CallResponse>> AsyncFunctionCallStream(PLContainerChannel *channel, grpc::ClientContext *context, const CallRequest &request, grpc::CompletionQueue *cq, void *tag);
+    void PrepareFunction(const plcProcInfo *proc, CallRequest &request);
+    bool CheckFunctionHandle(const grpc::Status &status, CallRequest &request, bool retry) { return this->CheckFunctionHandle(this->channel_.get(), status, request, retry); }
+    bool CheckFunctionHandle(PLContainerChannel *channel, const grpc::Status &status, CallRequest &request, bool retry);
+
+    // the channel Init() chose, stays valid for its holder after ReleaseChannel()
+    std::shared_ptr<PLContainerChannel> CurrentChannel() const { return this->channel_; }
 
     static void InitCallRequest(const FunctionCallInfo fcinfo, PlcRuntimeType type, CallRequest &request);
     static void InitCallRequest(const FunctionCallInfo fcinfo, const plcProcInfo *proc, PlcRuntimeType type, CallRequest &request);
+    static void InitCallRequestHeader(const FunctionCallInfo fcinfo, const plcProcInfo *proc, PlcRuntimeType type, CallRequest &request);
+    static void InitCallRequestArguments(const FunctionCallInfo fcinfo, const plcProcInfo *proc, google::protobuf::RepeatedPtrField<PlcValue> &args);
 
     static Datum GetCallResponseAsDatum(const FunctionCallInfo fcinfo, plcProcInfo *proc, const CallResponse &response);
 
@@ -61,6 +140,8 @@ private:
     static Datum getCallResponseAsDatum(const FunctionCallInfo fcinfo, plcProcInfo *proc, const CompositeData &response);
     static Datum getCallResponseAsDatum(const FunctionCallInfo fcinfo, plcProcInfo *proc, const SetOfData &response, int row_index);
 
+    bool registerFunction(PLContainerChannel *channel, const RegisterFunctionRequest &registerRequest, uint64_t *handle);
+
     static void setFunctionReturnType(::plcontainer::ReturnType* rettype, const plcTypeInfo *type, bool setof);
 
     static std::string functionCallInfoToStr(const FunctionCallInfo fcinfo);
@@ -70,18 +151,107 @@ private:
 private:
     static PLContainerClient *client;
 
-    std::unique_ptr<PLContainer::Stub> stub_;
+    std::map<std::string, std::shared_ptr<PLContainerChannel>> channels_;
+    std::shared_ptr<PLContainerChannel> channel_;
     const plcContext  *ctx;
 };
 
+/*
+ * Result set of a set returning function, read lazily chunk by chunk from
+ * FunctionCallStream. Runtimes without streaming get a single FunctionCall
+ * whose response is served as the only chunk. Each chunk is read on cq_ so
+ * the wait for it can be cancelled and is bounded by plc_client_timeout.
+ */
+class PLContainerResultStream {
+public:
+    PLContainerResultStream(PLContainerClient *client);
+    ~PLContainerResultStream();
+
+    void Start(const CallRequest &request);
+    CallResponse *Current();
+
+private:
+    bool readChunk();
+    bool wait(const char *operation);
+    void functionCall();
+    static int rows(const CallResponse &chunk);
+
+    PLContainerClient   *client_;
+    // the channel the call was started on, the client may switch meanwhile
+    std::shared_ptr<PLContainerChannel> channel_;
+    CallRequest         request_;
+    grpc::ClientContext context_;
+    grpc::CompletionQueue cq_;
+    std::unique_ptr<grpc::ClientAsyncReader<CallResponse>> reader_;
+    CallResponse        chunk_;
+    int                 chunks_;
+    bool                finished_;
+};
+
+/*
+ * Buffers the argument tuples of consecutive calls to the same function and
+ * ships them in one BatchFunctionCall once plcontainer.batch_size rows are
+ * collected, another function is called, or the statement ends. Up to
+ * plcontainer.max_inflight_calls batches per container run while the next
+ * one is being collected; Sync() waits for all of them. Batches of volatile
+ * functions never run along with another one, so that their side effects
+ * happen in calling order.
+ */
+class PLContainerBatch {
+public:
+    static PLContainerBatch *GetPLContainerBatch();
+
+    static bool IsBatchable(const FunctionCallInfo fcinfo, const plcProcInfo *proc);
+
+    void Append(const FunctionCallInfo fcinfo, const plcProcInfo *proc, PlcRuntimeType type, plcContext *ctx);
+    void Flush();
+    void Sync();
+    void Discard();
+    void DiscardSubTransaction(SubTransactionId subid);
+    bool IsPending() const { return PLContainerBatch::Rows(this->request_) > 0; }
+
+    static int Rows(const BatchCallRequest &request);
+
+private:
+    PLContainerBatch();
+
+    static bool isColumnar(const plcProcInfo *proc);
+
+    void reset();
+
+    int inflight(const plcContext *ctx) const;
+    bool inflightVolatile() const;
+    void waitOldest();
+
+    static PLContainerBatch *batch;
+
+    BatchCallRequest request_;
+    plcContext  *ctx_;
+    PlcRuntimeType type_;
+    Oid         funcOid_;
+    bool        columnar_;
+    bool        readonly_;
+    SubTransactionId subid_;
+
+    grpc::CompletionQueue   cq_;
+    std::deque<PLContainerPendingCall *> pending_;
+    std::unique_ptr<PLContainerPendingCall> completed_;
+};
+
 class PLCoordinatorClient {
 public:
     PLCoordinatorClient(std::shared_ptr<grpc::Channel> channel);
 
+    static PLCoordinatorClient *GetPLCoordinatorClient(const std::string &server_addr);
+
     void StartContainer(const StartContainerRequest &request, StartContainerResponse &response);
     void StopContainer(const StopContainerRequest &request, StopContainerResponse &response);
+    void ReleaseContainer(const ReleaseContainerRequest &request, ReleaseContainerResponse &response, int timeout_ms);
 
 private:
+    static PLCoordinatorClient *client;
+    static std::string address;
+
     std::unique_ptr<PLCoordinator::Stub> stub_;
 };
 
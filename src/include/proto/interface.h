@@ -24,6 +24,10 @@ extern "C"
 // C interface definition
 Datum plcontainer_function_handler(FunctionCallInfo fcinfo, plcProcInfo *proc, MemoryContext function_cxt); 
 void  plcontainer_inline_function_handler(FunctionCallInfo fcinfo, MemoryContext function_cxt);
+void  plcontainer_flush_batch(void);
+void  plcontainer_discard_batch(void);
+void  plcontainer_discard_subxact_batch(SubTransactionId subid);
+void  plcontainer_release_channel(const char *address);
 
 // plcoordinator server
 typedef struct PLCoordinatorServer {
@@ -32,11 +36,15 @@ typedef struct PLCoordinatorServer {
 } PLCoordinatorServer;
 
 PLCoordinatorServer *start_server(const char *address);
-int process_request(PLCoordinatorServer *server, int timeout_seconds);
+int process_request(PLCoordinatorServer *server);
+int get_server_event_fd(PLCoordinatorServer *server);
+void schedule_pool_container_start(PLCoordinatorServer *server, struct runtimeConfEntry *conf, const char *uds_dir, int dbid);
 int get_new_container_from_coordinator(const char *runtime_id, plcContext *ctx);
+void plcontainer_release_container(const char *runtime_id, const plcContext *ctx, int timeout_ms);
 
 // type io
 char *plc_datum_as_udt(Datum input, plcTypeInfo *type);
+char *plc_datum_as_numeric_binary(Datum input, plcTypeInfo *type);
 Datum plc_datum_from_udt(char *input, plcTypeInfo *type);
 
 char *plc_datum_as_array(Datum input, plcTypeInfo *type);
@@ -3,6 +3,15 @@
 
 #include "client.h"
 
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/text_format.h>
+
+extern "C"
+{
+#include "catalog/pg_type.h"
+#include "lib/stringinfo.h"
+}
+
 using namespace plcontainer;
 
 class PLContainerProtoUtils {
@@ -17,10 +26,34 @@ public:
     static Datum DatumFromProtoData(const SetOfData &ad, plcTypeInfo *type);
  
     static void SetScalarValue(ScalarData &data, const char *name, bool isnull, const plcTypeInfo *type, const char *value);
+    static char *DatumOutput(Datum input, plcTypeInfo *type);
+
+    static bool IsColumnType(const plcTypeInfo *type);
+    static void InitProtoColumn(ColumnData &col, const char *name, const plcTypeInfo *type);
+    static void AppendDatumToColumn(ColumnData &col, int row, Datum input, bool isnull, const plcTypeInfo *type);
+    static Datum DatumFromProtoColumn(const ColumnData &col, int row, plcTypeInfo *type, bool *isnull);
+    static Datum DatumFromProtoColumns(const ColumnarData &cd, int row, plcTypeInfo *type, bool *isnull);
+
+    static void ValuesFromProtoData(const CompositeData &cd, plcTypeInfo *type, Datum *values, bool *nulls);
+    static void ValuesFromProtoColumns(const ColumnarData &cd, int row, plcTypeInfo *type, Datum *values, bool *nulls);
+    static void ValuesFromProtoSetOf(const SetOfData &setof, int row, plcTypeInfo *type, Datum *values, bool *nulls);
+    static int SetOfRows(const SetOfData &setof);
+
     static PlcDataType GetDataType(const plcTypeInfo *type);
+
+    static std::string TracePayload(const google::protobuf::Message &msg);
+    static std::string TraceSummary(const google::protobuf::Message &msg);
 private:
     static bool isSetOf(const plcTypeInfo *type);
     static void DatumAsProtoArrayOrSetOf(Datum input, const plcTypeInfo *type, ArrayData *ad, SetOfData *setof);
+
+    static bool packedElementType(const plcTypeInfo *type, PackedElementType *packedType);
+    static int packedElementWidth(PackedElementType packedType);
+    static void datumAsProtoPackedArray(ArrayType *array, const plcTypeInfo *elementType, PackedElementType packedType, PackedArrayData &pd);
+    static Datum datumFromProtoPackedArray(const PackedArrayData &pd, plcTypeInfo *elementType);
+    static Datum packedElementAsDatum(const char *value, PackedElementType packedType, plcTypeInfo *elementType);
+    static void checkColumnSize(const ColumnData &col, int size, int row);
+    static Datum numericFromBinary(const std::string &value, const plcTypeInfo *type);
 };
 
 #endif 
@@ -66,10 +66,6 @@ interpreted as representing official policies, either expressed or implied, of t
   #include "access/htup_details.h"
 #endif
 
-static bool plc_procedure_valid(plcProcInfo *proc, HeapTuple procTup);
-
-static bool plc_type_valid(plcTypeInfo *type);
-
 void *top_palloc(size_t bytes) {
 	/* We need our allocations to be long-lived, so use TopMemoryContext */
 	return MemoryContextAlloc(TopMemoryContext, bytes);
@@ -94,154 +90,154 @@ plcProcInfo *plcontainer_procedure_get(FunctionCallInfo fcinfo) {
 		textHeapTup = NULL;
 	Form_pg_type typeTup;
 	plcProcInfo * volatile proc = NULL;
-
+	char procName[NAMEDATALEN + 256];
+	Form_pg_proc procStruct;
+	bool isnull;
+	int rv;
 
 	procoid = fcinfo->flinfo->fn_oid;
+
+	/*
+	 * Cached functions are marked stale by the syscache callbacks of the
+	 * function cache once their pg_proc row or any type they use changes,
+	 * so a valid entry is used without any catalog access.
+	 */
+	proc = function_cache_get(procoid);
+	if (proc != NULL) {
+		proc->hasChanged = 0;
+		return proc;
+	}
+
 	procHeapTup = SearchSysCache(PROCOID, procoid, 0, 0, 0);
 	if (!HeapTupleIsValid(procHeapTup)) {
 		plc_elog(ERROR, "cannot find proc with oid %u", procoid);
 	}
 
-	proc = function_cache_get(procoid);
+	procStruct = (Form_pg_proc) GETSTRUCT(procHeapTup);
+	rv = snprintf(procName, sizeof(procName), "__plpython_procedure_%s_%u",
+			NameStr(procStruct->proname), procoid/*TODOfn_oid*/);
+	if (rv < 0 || (unsigned int)rv >= sizeof(procName))
+		elog(ERROR, "procedure name would overrun buffer");
+
 	/*
-	 * All the catalog operations are done only if the cached function
-	 * information has changed in the catalog
+	 * Here we are using plc_top_alloc as the function structure should be
+	 * available across the function handler call
+	 *
+	 * Note: we free the procedure from within function_put_cache below
 	 */
-	if (!plc_procedure_valid(proc, procHeapTup)) {
-
-		char procName[NAMEDATALEN + 256];
-		Form_pg_proc procStruct;
-		bool isnull;
-		int rv;
-
-		procStruct = (Form_pg_proc) GETSTRUCT(procHeapTup);
-		rv = snprintf(procName, sizeof(procName), "__plpython_procedure_%s_%u",
-				NameStr(procStruct->proname), procoid/*TODOfn_oid*/);
-		if (rv < 0 || (unsigned int)rv >= sizeof(procName))
-			elog(ERROR, "procedure name would overrun buffer");
-
-		/*
-		 * Here we are using plc_top_alloc as the function structure should be
-		 * available across the function handler call
-		 *
-		 * Note: we free the procedure from within function_put_cache below
-		 */
-		proc = top_palloc(sizeof(plcProcInfo));
-		if (proc == NULL) {
-			plc_elog(FATAL, "Cannot allocate memory for plcProcInfo structure");
-		}
+	proc = top_palloc(sizeof(plcProcInfo));
+	if (proc == NULL) {
+		plc_elog(FATAL, "Cannot allocate memory for plcProcInfo structure");
+	}
 
-		proc->proname = plc_top_strdup(NameStr(procStruct->proname));
-		proc->pyname = plc_top_strdup(procName);
-		proc->funcOid = procoid;
-		proc->fn_xmin = HeapTupleHeaderGetXmin(procHeapTup->t_data);
-		proc->fn_tid = procHeapTup->t_self;
-		/* Remember if function is STABLE/IMMUTABLE */
-		proc->fn_readonly = (procStruct->provolatile != PROVOLATILE_VOLATILE);
-
-		proc->retset = fcinfo->flinfo->fn_retset;
-
-		proc->hasChanged = 1;
-
-		HeapTuple rvTypeTup;
-		Form_pg_type rvTypeStruct;
-
-		rvTypeTup = SearchSysCache1(TYPEOID,
-				ObjectIdGetDatum(procStruct->prorettype));
-		if (!HeapTupleIsValid(rvTypeTup))
-			elog(ERROR, "cache lookup failed for type %u",
-					procStruct->prorettype);
-		rvTypeStruct = (Form_pg_type) GETSTRUCT(rvTypeTup);
-
-		/* Disallow pseudotype result, except for void or record */
-		if (rvTypeStruct->typtype == TYPTYPE_PSEUDO) {
-			if (procStruct->prorettype == TRIGGEROID)
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg(
-								"trigger functions can only be called as triggers")));
-			else if (procStruct->prorettype != VOIDOID
-					&& procStruct->prorettype != RECORDOID)
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg(
-								"PLContainer functions cannot return type %s",
-								format_type_be(procStruct->prorettype))));
-		}
-		ReleaseSysCache(rvTypeTup);
-		procStruct = (Form_pg_proc) GETSTRUCT(procHeapTup);
+	proc->proname = plc_top_strdup(NameStr(procStruct->proname));
+	proc->pyname = plc_top_strdup(procName);
+	proc->funcOid = procoid;
+	proc->fn_xmin = HeapTupleHeaderGetXmin(procHeapTup->t_data);
+	proc->fn_tid = procHeapTup->t_self;
+	/* Remember if function is STABLE/IMMUTABLE */
+	proc->fn_readonly = (procStruct->provolatile != PROVOLATILE_VOLATILE);
+
+	proc->retset = fcinfo->flinfo->fn_retset;
+
+	proc->hasChanged = 1;
+
+	HeapTuple rvTypeTup;
+	Form_pg_type rvTypeStruct;
+
+	rvTypeTup = SearchSysCache1(TYPEOID,
+			ObjectIdGetDatum(procStruct->prorettype));
+	if (!HeapTupleIsValid(rvTypeTup))
+		elog(ERROR, "cache lookup failed for type %u",
+				procStruct->prorettype);
+	rvTypeStruct = (Form_pg_type) GETSTRUCT(rvTypeTup);
+
+	/* Disallow pseudotype result, except for void or record */
+	if (rvTypeStruct->typtype == TYPTYPE_PSEUDO) {
+		if (procStruct->prorettype == TRIGGEROID)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg(
+							"trigger functions can only be called as triggers")));
+		else if (procStruct->prorettype != VOIDOID
+				&& procStruct->prorettype != RECORDOID)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg(
+							"PLContainer functions cannot return type %s",
+							format_type_be(procStruct->prorettype))));
+	}
+	ReleaseSysCache(rvTypeTup);
+	procStruct = (Form_pg_proc) GETSTRUCT(procHeapTup);
 
-		fill_type_info(fcinfo, procStruct->prorettype, &proc->result);
+	fill_type_info(fcinfo, procStruct->prorettype, &proc->result);
 
-		proc->nargs = procStruct->pronargs;
-		if (proc->nargs > 0) {
-			// This is required to avoid the cycle from being removed by optimizer
-			int volatile j;
+	proc->nargs = procStruct->pronargs;
+	if (proc->nargs > 0) {
+		// This is required to avoid the cycle from being removed by optimizer
+		int volatile j;
 
-			proc->args = top_palloc(proc->nargs * sizeof(plcTypeInfo));
-			for (j = 0; j < proc->nargs; j++) {
-				fill_type_info(fcinfo, procStruct->proargtypes.values[j], &proc->args[j]);
-			}
+		proc->args = top_palloc(proc->nargs * sizeof(plcTypeInfo));
+		for (j = 0; j < proc->nargs; j++) {
+			fill_type_info(fcinfo, procStruct->proargtypes.values[j], &proc->args[j]);
+		}
 
-			argnamesArray = SysCacheGetAttr(PROCOID, procHeapTup,
-			                                Anum_pg_proc_proargnames, &isnull);
-			/* If at least some arguments have names */
-			if (!isnull) {
-				textHeapTup = SearchSysCache(TYPEOID, ObjectIdGetDatum(TEXTOID), 0, 0, 0);
-				if (!HeapTupleIsValid(textHeapTup)) {
-					plc_elog(FATAL, "cannot find text type in cache");
-				}
-				typeTup = (Form_pg_type) GETSTRUCT(textHeapTup);
-				deconstruct_array(DatumGetArrayTypeP(argnamesArray), TEXTOID,
-				                  typeTup->typlen, typeTup->typbyval, typeTup->typalign,
-				                  &argnames, &argnulls, &lenOfArgnames);
-				/* UDF may contain OUT parameter, which is not considered as 
-				 * arguement number. So the length of argname list(container both INPUT and OUTPUT) 
-				 * maybe smaller than arguement number. There is no need to pass OUTPUT name to container.
-				 */
-				if (lenOfArgnames < proc->nargs) {
-					plc_elog(ERROR, "Length of argname list(%d) should be equal to or larger than \
-							number of args(%d)", lenOfArgnames, proc->nargs);
-				}
+		argnamesArray = SysCacheGetAttr(PROCOID, procHeapTup,
+		                                Anum_pg_proc_proargnames, &isnull);
+		/* If at least some arguments have names */
+		if (!isnull) {
+			textHeapTup = SearchSysCache(TYPEOID, ObjectIdGetDatum(TEXTOID), 0, 0, 0);
+			if (!HeapTupleIsValid(textHeapTup)) {
+				plc_elog(FATAL, "cannot find text type in cache");
+			}
+			typeTup = (Form_pg_type) GETSTRUCT(textHeapTup);
+			deconstruct_array(DatumGetArrayTypeP(argnamesArray), TEXTOID,
+			                  typeTup->typlen, typeTup->typbyval, typeTup->typalign,
+			                  &argnames, &argnulls, &lenOfArgnames);
+			/* UDF may contain OUT parameter, which is not considered as 
+			 * arguement number. So the length of argname list(container both INPUT and OUTPUT) 
+			 * maybe smaller than arguement number. There is no need to pass OUTPUT name to container.
+			 */
+			if (lenOfArgnames < proc->nargs) {
+				plc_elog(ERROR, "Length of argname list(%d) should be equal to or larger than \
+						number of args(%d)", lenOfArgnames, proc->nargs);
 			}
+		}
 
-			proc->argnames = top_palloc(proc->nargs * sizeof(char *));
-			for (j = 0; j < proc->nargs; j++) {
-				if (!isnull && !argnulls[j]) {
-					proc->argnames[j] =
-						plc_top_strdup(DatumGetCString(
-							DirectFunctionCall1(textout, argnames[j])
-						));
-					if (strlen(proc->argnames[j]) == 0) {
-						pfree(proc->argnames[j]);
-						proc->argnames[j] = NULL;
-					}
-				} else {
+		proc->argnames = top_palloc(proc->nargs * sizeof(char *));
+		for (j = 0; j < proc->nargs; j++) {
+			if (!isnull && !argnulls[j]) {
+				proc->argnames[j] =
+					plc_top_strdup(DatumGetCString(
+						DirectFunctionCall1(textout, argnames[j])
+					));
+				if (strlen(proc->argnames[j]) == 0) {
+					pfree(proc->argnames[j]);
 					proc->argnames[j] = NULL;
 				}
+			} else {
+				proc->argnames[j] = NULL;
 			}
-
-			if (textHeapTup != NULL) {
-				ReleaseSysCache(textHeapTup);
-			}
-		} else {
-			proc->args = NULL;
-			proc->argnames = NULL;
 		}
 
-		/* Get the text and name of the function */
-		srcdatum = SysCacheGetAttr(PROCOID, procHeapTup, Anum_pg_proc_prosrc, &isnull);
-		if (isnull)
-			plc_elog(ERROR, "null prosrc");
-		proc->src = plc_top_strdup(DatumGetCString(DirectFunctionCall1(textout, srcdatum)));
-		namedatum = SysCacheGetAttr(PROCOID, procHeapTup, Anum_pg_proc_proname, &isnull);
-		if (isnull)
-			plc_elog(ERROR, "null proname");
-		proc->name = plc_top_strdup(DatumGetCString(DirectFunctionCall1(nameout, namedatum)));
-
-		/* Cache the function for later use */
-		function_cache_put(proc);
+		if (textHeapTup != NULL) {
+			ReleaseSysCache(textHeapTup);
+		}
 	} else {
-		proc->hasChanged = 0;
+		proc->args = NULL;
+		proc->argnames = NULL;
 	}
+
+	/* Get the text and name of the function */
+	srcdatum = SysCacheGetAttr(PROCOID, procHeapTup, Anum_pg_proc_prosrc, &isnull);
+	if (isnull)
+		plc_elog(ERROR, "null prosrc");
+	proc->src = plc_top_strdup(DatumGetCString(DirectFunctionCall1(textout, srcdatum)));
+	namedatum = SysCacheGetAttr(PROCOID, procHeapTup, Anum_pg_proc_proname, &isnull);
+	if (isnull)
+		plc_elog(ERROR, "null proname");
+	proc->name = plc_top_strdup(DatumGetCString(DirectFunctionCall1(nameout, namedatum)));
+
+	/* Cache the function for later use */
+	function_cache_put(proc);
 	ReleaseSysCache(procHeapTup);
 	return proc;
 }
@@ -260,66 +256,3 @@ void free_proc_info(plcProcInfo *proc) {
 	}
 	pfree(proc);
 }
-
-static bool plc_type_valid(plcTypeInfo *type) {
-	bool valid = true;
-	int i;
-
-	for (i = 0; i < type->nSubTypes && valid; i++) {
-		valid = plc_type_valid(&type->subTypes[i]);
-	}
-
-	/* We exclude record from testing here, as it would change only if the function
-	 * changes itself, which would be caugth by checking function creation xid */
-	if (valid && type->is_rowtype && !type->is_record) {
-		HeapTuple relTup;
-
-		Assert(OidIsValid(type->typ_relid));
-		Assert(TransactionIdIsValid(type->typrel_xmin));
-		Assert(ItemPointerIsValid(&type->typrel_tid));
-
-		// Get the pg_class tuple for the argument type
-		relTup = SearchSysCache1(RELOID, ObjectIdGetDatum(type->typ_relid));
-		if (!HeapTupleIsValid(relTup))
-			plc_elog(ERROR, "PL/Container cache lookup failed for relation %u", type->typ_relid);
-
-		// If commit transaction ID has changed or relation was moved within table
-		// our type information is no longer valid
-		if (type->typrel_xmin != HeapTupleHeaderGetXmin(relTup->t_data) ||
-		    !ItemPointerEquals(&type->typrel_tid, &relTup->t_self)) {
-			valid = false;
-		}
-
-		ReleaseSysCache(relTup);
-	}
-
-	return valid;
-}
-
-/*
- * Decide whether a cached PLyProcedure struct is still valid
- */
-static bool plc_procedure_valid(plcProcInfo *proc, HeapTuple procTup) {
-	bool valid = false;
-
-	if (proc != NULL) {
-		/* If the pg_proc tuple has changed, it's not valid */
-		if (proc->fn_xmin == HeapTupleHeaderGetXmin(procTup->t_data) &&
-		    ItemPointerEquals(&proc->fn_tid, &procTup->t_self)) {
-			int i;
-
-			valid = true;
-
-			// If there are composite input arguments, they might have changed
-			for (i = 0; i < proc->nargs && valid; i++) {
-				valid = plc_type_valid(&proc->args[i]);
-			}
-
-			// Also check for composite output type
-			if (valid) {
-				valid = plc_type_valid(&proc->result);
-			}
-		}
-	}
-	return valid;
-}
@@ -41,6 +41,7 @@
 #include "plc/plcontainer.h"
 #include "plc/plc_docker_api.h"
 #include "plc/plc_configuration.h"
+#include "plc/plc_coordinator.h"
 
 static runtimeConfEntry *parse_runtime_configuration(HTAB *table, xmlNode *node);
 
@@ -56,11 +57,17 @@ static void release_runtime_configuration_table(HTAB *table);
 
 static void print_runtime_configurations();
 
+extern int PlcDocker_list(int dbid, containerStatus **containers);
+
+extern int PlcDocker_stat(const char **ids, int length, int64_t *mem_usage);
+
 PG_FUNCTION_INFO_V1(refresh_plcontainer_config);
 
 PG_FUNCTION_INFO_V1(show_plcontainer_config);
 
 PG_FUNCTION_INFO_V1(containers_summary);
+
+PG_FUNCTION_INFO_V1(containers_registry);
 HTAB *runtime_conf_table = NULL;
 
 /* Function parses the container XML definition and fills the passed
@@ -125,6 +132,7 @@ static runtimeConfEntry *parse_runtime_configuration(HTAB *table, xmlNode *node)
 		/*runtime_id will be freed with conf_entry*/
 		conf_entry->memoryMb = 1024;
 		conf_entry->cpuShare = 1024;
+		conf_entry->poolSize = 0;
 		conf_entry->useContainerLogging = false;
 		conf_entry->useContainerNetwork = false;
 		conf_entry->resgroupOid = InvalidOid;
@@ -206,6 +214,20 @@ static runtimeConfEntry *parse_runtime_configuration(HTAB *table, xmlNode *node)
 						xmlFree((void *) value);
 						value = NULL;
 					}
+					value = xmlGetProp(cur_node, (const xmlChar *) "pool_size");
+					if (value != NULL) {
+						long poolSize = pg_atoi((char *) value, sizeof(int), 0);
+						validSetting = true;
+
+						if (poolSize < 0 || poolSize > PLC_MAX_POOL_SIZE) {
+							plc_elog(ERROR, "container pool size must be between 0 and %d, current string is %s",
+								PLC_MAX_POOL_SIZE, value);
+						} else {
+							conf_entry->poolSize = poolSize;
+						}
+						xmlFree((void *) value);
+						value = NULL;
+					}
 					/* Enforce to not use network for connection. In the future
 					 * this should be set by various backend implementation.
 					 */
@@ -427,6 +449,9 @@ static void print_runtime_configurations() {
 			plc_elog(INFO, "    image = '%s'", conf_entry->image);
 			plc_elog(INFO, "    memory_mb = '%d'", conf_entry->memoryMb);
 			plc_elog(INFO, "    cpu_share = '%d'", conf_entry->cpuShare);
+			if (conf_entry->poolSize > 0) {
+				plc_elog(INFO, "    pool_size = '%d'", conf_entry->poolSize);
+			}
 			plc_elog(INFO, "    use container logging  = '%s'", conf_entry->useContainerLogging ? "yes" : "no");
 			if (conf_entry->useUserControl){
 				plc_elog(INFO, "    allowed roles list  = '%s'", conf_entry->roles);
@@ -595,6 +620,19 @@ refresh_plcontainer_config(PG_FUNCTION_ARGS) {
 	}
 }
 
+/*
+ * Owner of container id as registered by the coordinator, or NULL. Pooled
+ * containers are created before any owner is known, their owner label stays
+ * empty once a QE takes one.
+ */
+static const char *
+registry_owner(ContainerEntry *entries, int n, const char *id) {
+	for (int i = 0; i < n; i++) {
+		if (strcmp(entries[i].containerId, id) == 0)
+			return entries[i].owner;
+	}
+	return NULL;
+}
 
 Datum
 containers_summary(pg_attribute_unused() PG_FUNCTION_ARGS) {
@@ -605,10 +643,12 @@ containers_summary(pg_attribute_unused() PG_FUNCTION_ARGS) {
 	int res;
 	TupleDesc tupdesc;
 	AttInMetadata *attinmeta;
-	struct json_object *container_list = NULL;
-	char *json_result;
 	bool isFirstCall = true;
 	containerStatus *datums = NULL;
+	containerStatus *containers = NULL;
+	ContainerEntry *entries = NULL;
+	int nentries;
+	int dbid = 0;
 
 	/* Init the container list in the first call and get the results back */
 	if (SRF_IS_FIRSTCALL()) {
@@ -621,86 +661,41 @@ containers_summary(pg_attribute_unused() PG_FUNCTION_ARGS) {
 		/* switch to memory context appropriate for multiple function calls */
 		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
 
-		res = plc_docker_list_container(&json_result);
-		if (res < 0) {
+#ifndef PLC_PG
+		dbid = GpIdentity.dbid;
+#endif
+		arraylen = PlcDocker_list(dbid, &containers);
+		if (arraylen < 0) {
 			plc_elog(ERROR, "Docker container list error");
 		}
 
-		/* no container running */
-		if (strcmp(json_result, "[]") == 0) {
-			funcctx->max_calls = 0;
-		}
-
-		container_list = json_tokener_parse(json_result);
-
-		if (container_list == NULL) {
-			plc_elog(ERROR, "Parse JSON object error, cannot get the containers summary");
-		}
-
-		arraylen = json_object_array_length(container_list);
-
-		struct json_object *containerObj = NULL;
-		struct json_object *containerStateObj = NULL;
-		int64_t containerMemoryUsage = 0;
-
-		struct json_object *statusObj = NULL;
-		const char *statusStr;
-		struct json_object *labelObj = NULL;
-		struct json_object *ownerObj = NULL;
-		const char *ownerStr;
-		const char *username;
-		struct json_object *dbidObj = NULL;
-		const char *dbidStr;
-		struct json_object *idObj = NULL;
-		const char *idStr;
-		char **ids = palloc(arraylen);
-		memset(ids, 0, arraylen);
+		const char *username = GetUserNameFromId(GetUserId());
+		const char **ids = palloc(sizeof(char *) * (arraylen + 1));
 		int actualLen = 0;
-		int64_t *mem_usage = palloc(sizeof(int64_t)*arraylen);
-		datums = (containerStatus *)palloc(sizeof(containerStatus)*arraylen);
-		memset(datums, 0, sizeof(containerStatus)*arraylen);
+		int64_t *mem_usage = palloc(sizeof(int64_t) * (arraylen + 1));
+		datums = (containerStatus *)palloc(sizeof(containerStatus) * (arraylen + 1));
+		memset(datums, 0, sizeof(containerStatus) * (arraylen + 1));
+		nentries = copy_container_registry(&entries);
 		for (int i = 0; i < arraylen; i++) {
-			containerObj = json_object_array_get_idx(container_list, i);
-			if (containerObj == NULL) {
-				plc_elog(ERROR, "Not a valid container.");
+			if (containers[i].ownerStr[0] == '\0') {
+				const char *owner = registry_owner(entries, nentries, containers[i].idStr);
+				if (owner != NULL && owner[0] != '\0')
+					containers[i].ownerStr = pstrdup(owner);
 			}
-
-			if (!json_object_object_get_ex(containerObj, "Status", &statusObj)) {
-				plc_elog(ERROR, "failed to get json \"Status\" field.");
-			}
-			statusStr = json_object_get_string(statusObj);
-			if (!json_object_object_get_ex(containerObj, "Labels", &labelObj)) {
-				plc_elog(ERROR, "failed to get json \"Labels\" field.");
-			}
-
-			if (!json_object_object_get_ex(labelObj, "owner", &ownerObj)) {
-				plc_elog(LOG, "failed to get json \"owner\" field. Maybe this container is not started by PL/Container");
+			if (containers[i].ownerStr[0] == '\0') {
+				plc_elog(DEBUG1, "container %s has no owner, it is pooled or not started by PL/Container", containers[i].idStr);
 				continue;
 			}
-			ownerStr = json_object_get_string(ownerObj);
-			username = GetUserNameFromId(GetUserId());
-			if (strcmp(ownerStr, username) != 0 && superuser() == false) {
-				plc_elog(DEBUG1, "Current username %s (not super user) is not match conatiner owner %s, skip", username, ownerStr);
+			if (strcmp(containers[i].ownerStr, username) != 0 && superuser() == false) {
+				plc_elog(DEBUG1, "Current username %s (not super user) is not match conatiner owner %s, skip", username, containers[i].ownerStr);
 				continue;
 			}
-
-			if (!json_object_object_get_ex(labelObj, "dbid", &dbidObj)) {
+			if (containers[i].dbidStr[0] == '\0') {
 				plc_elog(LOG, "failed to get json \"dbid\" field. Maybe this container is not started by PL/Container");
 				continue;
 			}
-			dbidStr = json_object_get_string(dbidObj);
-
-			if (!json_object_object_get_ex(containerObj, "Id", &idObj)) {
-				plc_elog(ERROR, "failed to get json \"Id\" field.");
-			}
-
-			idStr = json_object_get_string(idObj);
-			ids[actualLen] = idStr;
-			datums[actualLen].idStr = idStr;
-			datums[actualLen].statusStr = statusStr;
-			datums[actualLen].dbidStr = dbidStr;
-			datums[actualLen].ownerStr = ownerStr;
-			actualLen++;
+			ids[actualLen] = containers[i].idStr;
+			datums[actualLen++] = containers[i];
 		}
 		funcctx->max_calls = (uint32_t) actualLen;
 		res = PlcDocker_stat(ids, actualLen, mem_usage);
@@ -743,7 +738,7 @@ containers_summary(pg_attribute_unused() PG_FUNCTION_ARGS) {
 	if (isFirstCall) {
 		funcctx->user_fctx = (void *) datums;
 	} else {
-		datums = (json_object *) funcctx->user_fctx;
+		datums = (containerStatus *) funcctx->user_fctx;
 	}
 	/*if a record is not suitable, skip it and scan next record*/
 	while (1) {
@@ -752,10 +747,6 @@ containers_summary(pg_attribute_unused() PG_FUNCTION_ARGS) {
 			char **values;
 			HeapTuple tuple;
 			Datum result;
-			int res;
-			char *containerState = NULL;
-			struct json_object *memoryObj = NULL;
-			struct json_object *memoryUsageObj = NULL;
 			values = (char **) palloc(5 * sizeof(char *));
 			values[0] = (char *) palloc(8 * sizeof(char));
 			values[1] = (char *) palloc(80 * sizeof(char));
@@ -776,15 +767,84 @@ containers_summary(pg_attribute_unused() PG_FUNCTION_ARGS) {
 			result = HeapTupleGetDatum(tuple);
 			SRF_RETURN_NEXT(funcctx, result);
 		} else {
-			if (container_list != NULL) {
-				json_object_put(container_list);
-			}
 			SRF_RETURN_DONE(funcctx);
 		}
 	}
 
 }
 
+/*
+ * Function referenced from Postgres that lists the containers the coordinator
+ * of this segment handed to QEs, read from shared memory without asking docker
+ */
+Datum
+containers_registry(pg_attribute_unused() PG_FUNCTION_ARGS) {
+	FuncCallContext *funcctx;
+	ContainerEntry *entries;
+
+	if (SRF_IS_FIRSTCALL()) {
+		MemoryContext oldcontext;
+		TupleDesc tupdesc;
+		const char *username;
+		int n;
+		int i;
+		int visible = 0;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		/* like containers_summary, only superusers see the others' containers */
+		n = copy_container_registry(&entries);
+		username = GetUserNameFromId(GetUserId());
+		for (i = 0; i < n; i++) {
+			if (superuser() || strcmp(entries[i].owner, username) == 0)
+				entries[visible++] = entries[i];
+		}
+		funcctx->max_calls = (uint32_t) visible;
+		funcctx->user_fctx = (void *) entries;
+
+		tupdesc = CreateTemplateTupleDesc(7, false);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 1, "QE_PID",
+		                   INT4OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 2, "SESSION_ID",
+		                   INT4OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 3, "COMMAND_COUNT",
+		                   INT4OID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 4, "RUNTIME_ID",
+		                   TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 5, "OWNER",
+		                   TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 6, "CONTAINER_ID",
+		                   TEXTOID, -1, 0);
+		TupleDescInitEntry(tupdesc, (AttrNumber) 7, "SERVER_PID",
+		                   INT4OID, -1, 0);
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	entries = (ContainerEntry *) funcctx->user_fctx;
+	if (funcctx->call_cntr < funcctx->max_calls) {
+		ContainerEntry *entry = &entries[funcctx->call_cntr];
+		Datum values[7];
+		bool nulls[7];
+		HeapTuple tuple;
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(entry->key.qe_pid);
+		values[1] = Int32GetDatum(entry->key.conn);
+		values[2] = Int32GetDatum(entry->key.ccnt);
+		values[3] = CStringGetTextDatum(entry->runtimeid);
+		values[4] = CStringGetTextDatum(entry->owner);
+		values[5] = CStringGetTextDatum(entry->containerId);
+		values[6] = Int32GetDatum(entry->stand_alone_pid);
+		tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
+
 /*
  * Function referenced from Postgres that can update configuration on
  * specific GPDB segment
@@ -6,8 +6,12 @@
  */
 
 #include "postgres.h"
+#include <limits.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
+#include <sys/syscall.h>
 
 #include "access/tupdesc.h"
 #include "access/xact.h"
@@ -25,7 +29,9 @@
 #include "pgstat.h"
 #include "postmaster/bgworker.h"
 #include "storage/ipc.h"
+#include "storage/lwlock.h"
 #include "storage/proc.h"
+#include "storage/shmem.h"
 #include "tcop/idle_resource_cleaner.h"
 #include "tcop/utility.h"
 #include "utils/acl.h"
@@ -37,7 +43,10 @@
 #include "utils/ps_status.h"
 #include "utils/snapmgr.h"
 #include "utils/syscache.h"
-#include "storage/shm_toc.h"
+#include "utils/timestamp.h"
+#ifndef PLC_PG
+  #include "cdb/cdbvars.h"
+#endif
 
 #include "plc/plc_docker_api.h"
 #include "plc/plc_configuration.h"
@@ -51,10 +60,12 @@ PG_MODULE_MAGIC;
 extern void _PG_init(void);
 extern void plc_coordinator_main(Datum datum);
 extern void plc_coordinator_aux_main(Datum datum);
-extern int PlcDocker_create(runtimeConfEntry *conf, char **name, char *uds_dir, int qe_pid, int session_id, int ccnt,int uid, int gid,int procid, char* dbname, char *ownername);
-extern int PlcDocker_start(char *id, char *msg);
 extern int PlcDocker_delete(const char **ids, int length, char* msg);
+extern int PlcDocker_inspect_exited(const char **ids, int length, int *exited);
 extern int PlcDocker_stat(const char** ids, int length, int64_t *mem_usage);
+extern int PlcDocker_events_open(int dbid, long since);
+extern int PlcDocker_events_read(ContainerEvent *events, int max_events);
+extern void PlcDocker_events_close(void);
 // END OF PROTOTYPES.
 
 static volatile sig_atomic_t got_sigterm = false;
@@ -64,58 +75,184 @@ static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
 CoordinatorStruct *coordinator_shm;
 #define RECEIVE_BUF_SIZE 2048
 #define TIMEOUT_SEC 3
-#define MAX_START_RETRY 5
-#define INSPECT_DOCKER_AT_ROUNT 5
-/* meesage queue */
-shm_mq_handle *message_queue_handle;
-ShmqBufferStatus *message_queue_status;
-CoordinatorConstraint *coordinator_docker_constraint;
+/* how often the aux process checks that the QEs are still alive */
+#define LIVENESS_CHECK_INTERVAL_MS 2000
+#define MAX_CONTAINER_EVENTS 64
+#define MAX_EXITED_QES 64
+/* requests from the main process to the aux process */
+static QeRequestRing *request_ring;
 /* debug use only */
 bool plcontainer_stand_alone_mode = true;
 int plc_max_docker_creating_num = 3;
+int plc_max_containers = 1024;
+bool plc_reuse_containers = false;
+int plc_max_reusable_containers = 4;
+/* bumped whenever the runtime configuration is reloaded */
+uint32 plc_runtime_config_generation = 0;
 char *plcontainer_stand_alone_server_path;
 int plc_client_timeout = -1;
+int plc_batch_size = 1;
+bool plc_packed_array = false;
+bool plc_lossless_numeric = false;
+int plc_max_inflight_calls = 1;
+int plc_trace_payload_size = 1024;
+int plc_trace_payload_interval = 1;
+int plc_function_cache_size = 100;
+
+/* a started container waiting in the pool of its runtime */
+typedef struct PooledContainer
+{
+	char containerId[DEFAULT_STRING_BUFFER_SIZE];	/* filled by PlcDocker_create */
+	char udsAddress[DEFAULT_STRING_BUFFER_SIZE];
+} PooledContainer;
+
+/* the pool of a runtime, keyed by runtime id */
+typedef struct RuntimePool
+{
+	char runtimeid[RUNTIME_ID_MAX_LENGTH];	/* hash key */
+	int nContainers;
+	int nStarting;	/* being started by the server for the pool */
+	TimestampTz retryAfter;	/* not refilled before, after a failed start */
+	PooledContainer containers[PLC_MAX_POOL_SIZE];
+} RuntimePool;
+
+/* the released containers of a runtime and owner, reset and ready for reuse */
+typedef struct ReusableKey
+{
+	char runtimeid[RUNTIME_ID_MAX_LENGTH];
+	char owner[NAMEDATALEN];
+} ReusableKey;
+
+typedef struct ReusableContainers
+{
+	ReusableKey key;	/* hash key */
+	int nContainers;
+	PooledContainer containers[PLC_MAX_POOL_SIZE];
+} ReusableContainers;
 
 static int send_message(QeRequest *request);
 static int receive_message();
 static int handle_request(QeRequest *req);
 static int start_stand_alone_process(const char* uds_address);
-static void shm_message_queue_receiver_init(dsm_segment *seg);
-static dsm_handle shm_message_queue_sender_init();
+static Size request_ring_size(void);
+static void init_request_ring(void);
+static HTAB *init_runtime_info_table(void);
 static int update_containers_status(bool inspect);
+static int open_container_events(long since);
+static int handle_container_events(void);
+static void init_qe_exit_watch(void);
+static void watch_qe_exit(ContainerKey *key);
+static void handle_qe_exits(void);
+static void remove_qe_containers(struct QeProcess *qe);
+static HTAB *init_runtime_pool_table(void);
+static int take_pooled_container(const char *runtimeid, const char *owner, ContainerKey *key, char *uds_address, char *container_id, char *log_msg);
+static bool refill_container_pools(PLCoordinatorServer *server);
+static void drain_container_pools(void);
+static HTAB *init_reusable_container_table(void);
+static void make_reusable_key(ReusableKey *key, const char *runtimeid, const char *owner);
+static int take_reusable_container(const char *runtimeid, const char *owner, ContainerKey *key, char *uds_address, char *container_id, char *log_msg);
+static HTAB *init_container_id_index(void);
+static void unregister_container(ContainerEntry *entry);
 
 HTAB *container_status_table;
 
+/*
+ * The registry entry of a container by its id, kept along with the registry
+ * under registryLock. Docker events name the container only, and pooled or
+ * reused containers carry labels of no or another QE.
+ */
+typedef struct ContainerIdEntry
+{
+	char            containerId[CONTAINER_ID_SIZE];	/* hash key */
+	ContainerKey    key;
+} ContainerIdEntry;
+
+static HTAB *container_id_index;
+/* pools of started containers per runtime, only used by the main process */
+static HTAB *runtime_pool_table = NULL;
+static int pooled_container_seq = 0;
+/* released containers kept for reuse, only used by the main process */
+static HTAB *reusable_container_table = NULL;
+
+/* a QE with containers, watched by the aux process through a pidfd */
+typedef struct QeProcess
+{
+	pid_t qe_pid;	/* hash key */
+	int pidfd;
+	bool polled;	/* no pidfd could be set up, polled with kill() instead */
+	List *keys;		/* ContainerKeys of its containers, in TopMemoryContext */
+} QeProcess;
+
+/*
+ * The aux process waits on aux_epfd for the docker event stream and the exit
+ * of QEs, qe_exit_watched is cleared if the kernel has no pidfd_open() and
+ * the QEs have to be polled instead.
+ */
+static int aux_epfd = -1;
+static HTAB *qe_process_table = NULL;
+static bool qe_exit_watched = false;
+/* the watched QEs that are polled nevertheless, see watch_qe_exit() */
+static int qe_polled = 0;
+
 static void
 plc_coordinator_shmem_startup(void)
 {
     bool found;
     if (prev_shmem_startup_hook)
         prev_shmem_startup_hook();
+    LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
     coordinator_shm = ShmemInitStruct(CO_SHM_KEY, MAXALIGN(sizeof(CoordinatorStruct)), &found);
-    Assert(!found);
-    coordinator_shm->state = CO_STATE_UNINITIALIZED;
+    if (!found) {
+        coordinator_shm->state = CO_STATE_UNINITIALIZED;
+        coordinator_shm->registryLock = LWLockAssign();
+    }
+    container_status_table = init_runtime_info_table();
+    container_id_index = init_container_id_index();
+    request_ring = ShmemInitStruct(QE_REQUEST_RING_KEY, request_ring_size(), &found);
+    if (!found)
+        init_request_ring();
+    LWLockRelease(AddinShmemInitLock);
 }
 
 static void
 request_shmem_(void)
 {
     RequestAddinShmemSpace(MAXALIGN(sizeof(CoordinatorStruct)));
+    RequestAddinShmemSpace(hash_estimate_size(plc_max_containers, sizeof(ContainerEntry)));
+    RequestAddinShmemSpace(hash_estimate_size(plc_max_containers, sizeof(ContainerIdEntry)));
+    RequestAddinShmemSpace(request_ring_size());
+    RequestAddinLWLocks(1);
 
     prev_shmem_startup_hook = shmem_startup_hook;
     shmem_startup_hook = plc_coordinator_shmem_startup;
 }
 
-HTAB*
-init_runtime_info_table() {
+/* The registry of the containers handed to QEs, see ContainerEntry */
+static HTAB*
+init_runtime_info_table(void) {
 	HASHCTL hash_ctl;
 	memset(&hash_ctl, 0, sizeof(hash_ctl));
 	hash_ctl.keysize = sizeof(ContainerKey);
 	hash_ctl.entrysize = sizeof(ContainerEntry);
-	hash_ctl.hcxt = CurrentMemoryContext;
+	hash_ctl.hash = tag_hash;
+	return ShmemInitHash("plcontainer container registry",
+								plc_max_containers,
+								plc_max_containers,
+								&hash_ctl,
+								HASH_ELEM | HASH_FUNCTION);
+}
+
+/* See ContainerIdEntry */
+static HTAB*
+init_container_id_index(void) {
+	HASHCTL hash_ctl;
+	memset(&hash_ctl, 0, sizeof(hash_ctl));
+	hash_ctl.keysize = CONTAINER_ID_SIZE;
+	hash_ctl.entrysize = sizeof(ContainerIdEntry);
 	hash_ctl.hash = string_hash;
-	return hash_create("container info hash",
-								8,
+	return ShmemInitHash("plcontainer container id index",
+								plc_max_containers,
+								plc_max_containers,
 								&hash_ctl,
 								HASH_ELEM | HASH_FUNCTION);
 }
@@ -146,15 +283,13 @@ plc_coordinator_sighup(pg_attribute_unused() SIGNAL_ARGS)
  *     like inspect docker
  */
 static int
-plc_initialize_coordinator(dsm_handle seg)
+plc_initialize_coordinator(void)
 {
 	BackgroundWorker auxWorker;
 
     char address[1024] = {0};
     snprintf(address, sizeof(address), "/tmp/.plcoordinator.%ld.unix.sock", (long)getpid());
     coordinator_shm->protocol = CO_PROTO_UNIX;
-	coordinator_docker_constraint = (CoordinatorConstraint*) top_palloc(sizeof(CoordinatorConstraint));
-	memset(coordinator_docker_constraint, 0, sizeof(CoordinatorConstraint));
     strcpy(coordinator_shm->address, address);
 
 	if (plc_refresh_container_config(false) != 0) {
@@ -171,7 +306,7 @@ plc_initialize_coordinator(dsm_handle seg)
 	auxWorker.bgw_start_time = BgWorkerStart_RecoveryFinished;
 	auxWorker.bgw_restart_time = BGW_DEFAULT_RESTART_INTERVAL;
 	auxWorker.bgw_main = plc_coordinator_aux_main;
-	auxWorker.bgw_main_arg = UInt32GetDatum(seg);
+	auxWorker.bgw_main_arg = (Datum) 0;
 
 	auxWorker.bgw_notify_pid = 0;
 	snprintf(auxWorker.bgw_name, sizeof(auxWorker.bgw_name), "plcoordinator_aux");
@@ -228,23 +363,52 @@ void handle_config_file_events(int fd, int wd)
 					}
 				} else {
 					elog(LOG, "PL/container: refresh runtime configuration");
+					/* pooled containers may run with the old settings */
+					plc_runtime_config_generation++;
+					drain_container_pools();
 				}
 			}
 		}
 	}
 }
 
+/*
+ * One fd for WaitLatchOrSocket() that is readable as soon as the config file
+ * changed or the server has completion queue events to process.
+ */
+static int
+create_coordinator_epoll(int configfd, int serverfd)
+{
+	struct epoll_event event;
+	int epfd;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0)
+		elog(ERROR, "failed to create epoll fd: %m");
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = configfd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, configfd, &event) < 0)
+		elog(ERROR, "failed to watch config file events: %m");
+	event.data.fd = serverfd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, serverfd, &event) < 0)
+		elog(ERROR, "failed to watch server events: %m");
+	return epfd;
+}
+
 void
 plc_coordinator_main(Datum datum)
 {
     int rc;
-	dsm_handle seg;
 	int configfd, configwd;
+	int epfd;
+	long timeout;
 	
     (void)datum;
     pqsignal(SIGTERM, plc_coordinator_sigterm);
     pqsignal(SIGHUP, plc_coordinator_sighup);
-	seg = shm_message_queue_sender_init();
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, "plcontainer coordinator");
 	configfd = inotify_init1(IN_NONBLOCK);
 	if (configfd < 0) {
 		elog(ERROR, "failed to do inotify_init");
@@ -253,40 +417,51 @@ plc_coordinator_main(Datum datum)
 	elog(LOG, "config file is %s", configfile);
 	configwd = inotify_add_watch(configfd, configfile, IN_OPEN | IN_CLOSE | IN_MODIFY);
 	
-    plc_initialize_coordinator(seg);
+    plc_initialize_coordinator();
     BackgroundWorkerUnblockSignals();
 
     coordinator_shm->state = CO_STATE_READY;
     elog(INFO, "plcoordinator is going to enter main loop");
-	if (plcontainer_stand_alone_mode) {
-		container_status_table = init_runtime_info_table();
-		if (container_status_table == NULL) {
-			elog(ERROR, "Failed to init container status hash table");
-		}
+	if (!plcontainer_stand_alone_mode) {
+		runtime_pool_table = init_runtime_pool_table();
+		reusable_container_table = init_reusable_container_table();
 	}
 
     PLCoordinatorServer *server = start_server(coordinator_shm->address);
     plc_elog(LOG, "server is started on address:%s", server->address);
-
+	epfd = create_coordinator_epoll(configfd, get_server_event_fd(server));
+
+    /*
+     * Sleep until a signal, a config file change or a server event arrives.
+     * Only stand alone processes and pools waiting to retry a failed start
+     * need polling, the first round schedules the pool refills right away.
+     */
+    timeout = 0;
     while (!got_sigterm) {
         ResetLatch(&MyProc->procLatch);
         if (got_sighup) {
             got_sighup = false;
         }
-        rc = WaitLatch(&MyProc->procLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 0);
+        rc = WaitLatchOrSocket(&MyProc->procLatch,
+                               WL_LATCH_SET | WL_SOCKET_READABLE | WL_POSTMASTER_DEATH | (timeout >= 0 ? WL_TIMEOUT : 0),
+                               epfd, timeout);
         if (rc & WL_POSTMASTER_DEATH)
             break;
         handle_config_file_events(configfd, configwd);
-        if (process_request(server, TIMEOUT_SEC) < 0) {
+        if (process_request(server) < 0) {
             plc_elog(ERROR, "server process request error.");
         }
 
+        timeout = -1;
         if (plcontainer_stand_alone_mode) {
             update_containers_status(false);
+            timeout = TIMEOUT_SEC * 1000L;
+        } else if (refill_container_pools(server)) {
+            timeout = TIMEOUT_SEC * 1000L;
         }
-		
     }
 
+    drain_container_pools();
     if (coordinator_shm->protocol != CO_PROTO_TCP)
         unlink(coordinator_shm->address);
     proc_exit(0);
@@ -296,42 +471,65 @@ void
 plc_coordinator_aux_main(Datum datum)
 {
     int rc;
-	dsm_segment *seg;
+	int events_sock = -1;
+	long events_since = -1;
+	long timeout;
+	TimestampTz last_check = 0;
+	TimestampTz now;
 	if (!plcontainer_stand_alone_mode) {
-		container_status_table = init_runtime_info_table();
-		if (container_status_table == NULL) {
-			elog(ERROR, "Failed to init container status hash table");
-		}
+		init_qe_exit_watch();
 	}
     pqsignal(SIGTERM, plc_coordinator_sigterm);
     pqsignal(SIGHUP, SIG_IGN);
 	/* TODO: error process */
 	CurrentResourceOwner = ResourceOwnerCreate(NULL, "plcontainer monitor");
-	seg = dsm_attach(DatumGetUInt32(datum));
-	shm_message_queue_receiver_init(seg);
+	(void) datum;
+	/* requests sent before the aux process started are waiting in the ring */
+	__atomic_store_n(&request_ring->consumer, &MyProc->procLatch, __ATOMIC_RELEASE);
     BackgroundWorkerUnblockSignals();
 	bool inspect = false;
-	int round_count = 0;
+
+	/*
+	 * Exited containers are learned from the docker event stream and exited
+	 * QEs from their pidfds, nothing is polled while both work. Each container
+	 * is inspected once more whenever the stream has to be (re)opened, for
+	 * what was missed meanwhile. The latch is reset before the ring is read,
+	 * so a request sent while reading it wakes up the next wait.
+	 */
     while(!got_sigterm) {
-        ResetLatch(&MyProc->procLatch);
-        rc = WaitLatch(&MyProc->procLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH, 0);
+        timeout = -1;
+        if (!plcontainer_stand_alone_mode && (events_sock < 0 || !qe_exit_watched || qe_polled > 0))
+            timeout = LIVENESS_CHECK_INTERVAL_MS;
+        rc = WaitLatchOrSocket(&MyProc->procLatch,
+                               WL_LATCH_SET | WL_POSTMASTER_DEATH | (timeout >= 0 ? WL_TIMEOUT : 0) | (aux_epfd >= 0 ? WL_SOCKET_READABLE : 0),
+                               aux_epfd, timeout);
         if (rc & WL_POSTMASTER_DEATH)
             break;
+        ResetLatch(&MyProc->procLatch);
         receive_message();
         if (!plcontainer_stand_alone_mode) {
-			if (round_count % INSPECT_DOCKER_AT_ROUNT == 0)
-			{
+			handle_qe_exits();
+			if (events_sock >= 0 && handle_container_events() < 0) {
+				elog(LOG, "PLC coordinator: docker event stream closed");
+				events_sock = -1;
+			}
+			if (events_sock < 0) {
+				events_sock = open_container_events(events_since);
 				inspect = true;
-				round_count = 0;
-			} else {
+			}
+			now = GetCurrentTimestamp();
+			if (inspect || (!qe_exit_watched && TimestampDifferenceExceeds(last_check, now, LIVENESS_CHECK_INTERVAL_MS))) {
+				update_containers_status(inspect);
+				last_check = now;
 				inspect = false;
+				if (events_sock >= 0)
+					events_since = (long) time(NULL);
 			}
-            update_containers_status(inspect);
         }
-        sleep(2);
-		round_count++;
     }
 
+	__atomic_store_n(&request_ring->consumer, NULL, __ATOMIC_RELEASE);
+	PlcDocker_events_close();
     proc_exit(0);
 }
 
@@ -340,7 +538,6 @@ _PG_init(void)
 {
     BackgroundWorker worker;
 
-    request_shmem_();
     memset(&worker, 0, sizeof(BackgroundWorker));
 
     /* coordinator.so must be in shared_preload_libraries to init SHM. */
@@ -380,6 +577,36 @@ _PG_init(void)
 							NULL,
 							NULL,
 							NULL);
+	DefineCustomIntVariable("plcontainer.max_containers",
+							"The max number of containers of all QEs tracked in shared memory",
+							NULL,
+							&plc_max_containers,
+							1024, 16, 1000000,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+	DefineCustomBoolVariable("plcontainer.reuse_containers",
+							 "Reset the containers QEs are done with and hand them to new QEs of the same owner",
+							 NULL,
+							 &plc_reuse_containers,
+							 false,
+							 PGC_SIGHUP,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+	DefineCustomIntVariable("plcontainer.max_reusable_containers",
+							"The max number of reset containers kept per runtime and owner",
+							NULL,
+							&plc_max_reusable_containers,
+							4, 0, PLC_MAX_POOL_SIZE,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
 	DefineCustomIntVariable("plcontainer.plc_client_timeout",
 							"The plcontainer client timeout for function call",
 							NULL,
@@ -390,6 +617,79 @@ _PG_init(void)
 							NULL,
 							NULL,
 							NULL);
+	DefineCustomIntVariable("plcontainer.batch_size",
+							"The max number of rows of a void function shipped in one function call, 1 disables batching",
+							NULL,
+							&plc_batch_size,
+							1, 1, 100000,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+	DefineCustomIntVariable("plcontainer.max_inflight_calls",
+							"The max number of batched function calls running in one container at the same time",
+							NULL,
+							&plc_max_inflight_calls,
+							1, 1, 64,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+	DefineCustomIntVariable("plcontainer.trace_payload_size",
+							"The max bytes of a request or response dumped in the trace logs, 0 for sizes only, -1 for no limit",
+							NULL,
+							&plc_trace_payload_size,
+							1024, -1, INT_MAX,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+	DefineCustomIntVariable("plcontainer.trace_payload_interval",
+							"Dump the payload of one in every this many traced messages",
+							NULL,
+							&plc_trace_payload_interval,
+							1, 1, INT_MAX,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+	DefineCustomIntVariable("plcontainer.function_cache_size",
+							"The max number of PL/Container functions whose catalog information is cached per session",
+							NULL,
+							&plc_function_cache_size,
+							100, 1, 100000,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+	DefineCustomBoolVariable("plcontainer.packed_array",
+							 "Send arrays of fixed width types as one packed buffer",
+							 NULL,
+							 &plc_packed_array,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+	DefineCustomBoolVariable("plcontainer.lossless_numeric",
+							 "Send bigint and numeric values exactly instead of as float8",
+							 NULL,
+							 &plc_lossless_numeric,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+    /* sized by plcontainer.max_containers */
+    request_shmem_();
 
     worker.bgw_flags = BGWORKER_SHMEM_ACCESS;
     worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
@@ -404,118 +704,403 @@ _PG_init(void)
     elog(NOTICE, "init plc_coordinator %d done", (int)getpid());
 }
 
-static int store_container_info(ContainerKey *key, pid_t server_pid, char* container_id)
+/*
+ * Register the container of a QE. The coordinator does so before answering the
+ * QE, so the QE always finds its container in the registry.
+ */
+static int store_container_info(ContainerKey *key, pid_t server_pid, const char *runtimeid, const char *owner, const char *container_id)
 {
 	ContainerEntry *entry = NULL;
+	ContainerIdEntry *id_entry;
 	bool found = false;
-	entry = (ContainerEntry *) hash_search(container_status_table, key, HASH_ENTER,
+	char previous_id[sizeof(entry->containerId)];
+
+	previous_id[0] = '\0';
+	LWLockAcquire(coordinator_shm->registryLock, LW_EXCLUSIVE);
+	entry = (ContainerEntry *) hash_search(container_status_table, key, HASH_ENTER_NULL,
 											&found);
+	if (entry == NULL) {
+		LWLockRelease(coordinator_shm->registryLock);
+		elog(WARNING, "too many containers, increase plcontainer.max_containers");
+		return -1;
+	}
 	if (found) {
 		if (entry->stand_alone_pid != 0) {
 			elog(LOG, "previous server process exist %d", entry->stand_alone_pid);
+		} else if (entry->containerId[0] != '\0') {
+			snprintf(previous_id, sizeof(previous_id), "%s", entry->containerId);
 		}
-		if (entry->containerId[0] != '\0') {
-			elog(LOG, "key %d previous container Id exist %s, will delete it", key->qe_pid, entry->containerId);
-			plc_docker_delete_container(entry->containerId);
-		}
+		hash_search(container_id_index, entry->containerId, HASH_REMOVE, NULL);
 	}
 	entry->stand_alone_pid = server_pid;
-	entry->key.qe_pid = key->qe_pid;
-	entry->key.conn = key->conn;
 	snprintf(entry->containerId, sizeof(entry->containerId), "%s", container_id);
-	elog(LOG, "put key %p %d value %s into hash table", &(entry->key), entry->key.qe_pid, entry->containerId);
+	snprintf(entry->runtimeid, sizeof(entry->runtimeid), "%s", runtimeid);
+	snprintf(entry->owner, sizeof(entry->owner), "%s", owner);
+	id_entry = (ContainerIdEntry *) hash_search(container_id_index, entry->containerId, HASH_ENTER_NULL, NULL);
+	if (id_entry == NULL) {
+		hash_search(container_status_table, key, HASH_REMOVE, NULL);
+		LWLockRelease(coordinator_shm->registryLock);
+		elog(WARNING, "too many containers, increase plcontainer.max_containers");
+		return -1;
+	}
+	id_entry->key = *key;
+	LWLockRelease(coordinator_shm->registryLock);
+
+	if (previous_id[0] != '\0') {
+		elog(LOG, "key %d previous container Id exist %s, will delete it", key->qe_pid, previous_id);
+		plc_docker_delete_container(previous_id);
+	}
+	elog(LOG, "put key %d value %s into hash table", key->qe_pid, container_id);
 	return 0;
 }
 
+/* Unregister the container of a QE and remove it */
 static int clear_container_info(ContainerKey *key)
 {
 	ContainerEntry *entry = NULL;
-	bool found = false;
+	ContainerEntry removed;
 	int res = 0;
-	entry = (ContainerEntry *) hash_search(container_status_table, key, HASH_FIND,
-											&found);
-	if (!found || entry == NULL) {
+
+	LWLockAcquire(coordinator_shm->registryLock, LW_EXCLUSIVE);
+	entry = (ContainerEntry *) hash_search(container_status_table, key, HASH_FIND, NULL);
+	if (entry != NULL) {
+		removed = *entry;
+		unregister_container(entry);
+	}
+	LWLockRelease(coordinator_shm->registryLock);
+	if (entry == NULL) {
 		elog(LOG, "failed to find server info");
 		return -1;
 	}
-	if (entry->stand_alone_pid != 0) {
-		elog(LOG, "try to terminate server process %d", entry->stand_alone_pid);
-		res = kill(entry->stand_alone_pid, SIGKILL);
-		if (waitpid(entry->stand_alone_pid, NULL, 0) < 0) {
-			elog(LOG, "failed terminate server process %d", entry->stand_alone_pid);
+
+	if (removed.stand_alone_pid != 0) {
+		elog(LOG, "try to terminate server process %d", removed.stand_alone_pid);
+		res = kill(removed.stand_alone_pid, SIGKILL);
+		if (waitpid(removed.stand_alone_pid, NULL, 0) < 0) {
+			elog(LOG, "failed terminate server process %d", removed.stand_alone_pid);
 		}
-		
-		entry->stand_alone_pid = 0;
 		return 0;
 	}
-	if (entry->containerId[0] != '\0') {
-		res = plc_docker_delete_container(entry->containerId);
-		snprintf(entry->containerId, sizeof(entry->containerId), "");
+	if (removed.containerId[0] != '\0') {
+		res = plc_docker_delete_container(removed.containerId);
 	}
 
 	return res;
 }
 
-int create_container(runtimeConfEntry *runtime_entry, ContainerKey *key, char **docker_name, char *uds_dir, int dbid, char *ownername)
+/*
+ * Whether the container a QE got is still registered, i.e. neither exited nor
+ * removed. Called by the QEs themselves.
+ */
+bool lookup_container(pid_t qe_pid, int session_id, int ccnt, const char *container_id)
 {
-	int res = 0;
-	SpinLockAcquire(&coordinator_docker_constraint->mutex);
-	if (coordinator_docker_constraint->dockerCreating < plc_max_docker_creating_num) {
-		coordinator_docker_constraint->dockerCreating++;
-	} else {
-		SpinLockRelease(&coordinator_docker_constraint->mutex);
-		elog(WARNING, "Too many dockers are creating now, retry later");
-		return -1;
+	ContainerKey key;
+	ContainerEntry *entry;
+	bool found;
+
+	key.qe_pid = qe_pid;
+	key.conn = session_id;
+	key.ccnt = ccnt;
+	LWLockAcquire(coordinator_shm->registryLock, LW_SHARED);
+	entry = (ContainerEntry *) hash_search(container_status_table, &key, HASH_FIND, NULL);
+	found = entry != NULL && strcmp(entry->containerId, container_id) == 0;
+	LWLockRelease(coordinator_shm->registryLock);
+	return found;
+}
+
+/* A palloc'd copy of the registry entries in *entries, returns their number */
+int copy_container_registry(ContainerEntry **entries)
+{
+	HASH_SEQ_STATUS scan;
+	ContainerEntry *entry;
+	int n = 0;
+
+	LWLockAcquire(coordinator_shm->registryLock, LW_SHARED);
+	*entries = palloc((hash_get_num_entries(container_status_table) + 1) * sizeof(ContainerEntry));
+	hash_seq_init(&scan, container_status_table);
+	while ((entry = (ContainerEntry *) hash_seq_search(&scan)) != NULL) {
+		(*entries)[n++] = *entry;
 	}
-	SpinLockRelease(&coordinator_docker_constraint->mutex);
+	LWLockRelease(coordinator_shm->registryLock);
+	return n;
+}
 
-	res = PlcDocker_create(runtime_entry, docker_name, uds_dir, key->qe_pid, key->conn, key->ccnt, getuid(), getgid(),MyProcPid, dbid, ownername);
+/* Remove entry from the registry and the id index, registryLock held exclusively */
+static void unregister_container(ContainerEntry *entry)
+{
+	ContainerIdEntry *id_entry;
+	ContainerKey key = entry->key;
 
-	if (res != 0) {
-		elog(WARNING, "create container failed");
-		SpinLockAcquire(&coordinator_docker_constraint->mutex);
-		coordinator_docker_constraint->dockerCreating--;
-		SpinLockRelease(&coordinator_docker_constraint->mutex);
-		return -1;
+	id_entry = (ContainerIdEntry *) hash_search(container_id_index, entry->containerId, HASH_FIND, NULL);
+	if (id_entry != NULL && memcmp(&id_entry->key, &key, sizeof(ContainerKey)) == 0)
+		hash_search(container_id_index, entry->containerId, HASH_REMOVE, NULL);
+	hash_search(container_status_table, &key, HASH_REMOVE, NULL);
+}
+
+/*
+ * Register a container handed to a QE and let the aux process watch the QE.
+ * On failure the container is removed, as nothing would remove it once the
+ * QE exits.
+ */
+static int report_container_created(ContainerKey *key, const char *runtimeid, const char *owner, const char *container_id)
+{
+	QeRequest request;
+	int res;
+
+	res = store_container_info(key, 0, runtimeid, owner, container_id);
+	if (res != 0)
+	{
+		plc_docker_delete_container(container_id);
+		return res;
 	}
-	QeRequest *request = (QeRequest*) palloc (sizeof(QeRequest));
-	request->pid = key->qe_pid;
-	request->conn = key->conn;
-	request->ccnt = key->ccnt;
-	request->requestType = CREATE_SERVER;
-	request->server_pid = 0;
-	snprintf(request->containerId, sizeof(request->containerId), "%s", *docker_name);
-	res = send_message(request);
+	memset(&request, 0, sizeof(QeRequest));
+	request.pid = key->qe_pid;
+	request.conn = key->conn;
+	request.ccnt = key->ccnt;
+	request.requestType = CREATE_SERVER;
+	request.server_pid = 0;
+	snprintf(request.containerId, sizeof(request.containerId), "%s", container_id);
+	res = send_message(&request);
 	if (res != 0)
 	{
-		elog(WARNING, "send start server message for %d--%s failure", key->qe_pid, *docker_name);
+		elog(WARNING, "send start server message for %d--%s failure", key->qe_pid, container_id);
+		clear_container_info(key);
 	} else {
-		elog(LOG, "send start server message for %d--%s success", key->qe_pid, *docker_name);
+		elog(LOG, "send start server message for %d--%s success", key->qe_pid, container_id);
 	}
-	SpinLockAcquire(&coordinator_docker_constraint->mutex);
-	coordinator_docker_constraint->dockerCreating--;
-	SpinLockRelease(&coordinator_docker_constraint->mutex);
 	return res;
 }
 
-int run_container(char *docker_name)
+static HTAB *init_runtime_pool_table(void)
 {
-	int res = 0;
+	HASHCTL hash_ctl;
+	memset(&hash_ctl, 0, sizeof(hash_ctl));
+	hash_ctl.keysize = RUNTIME_ID_MAX_LENGTH;
+	hash_ctl.entrysize = sizeof(RuntimePool);
+	hash_ctl.hcxt = TopMemoryContext;
+	hash_ctl.hash = string_hash;
+	return hash_create("runtime pool hash",
+								MAX_EXPECTED_RUNTIME_NUM,
+								&hash_ctl,
+								HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+/*
+ * Hand a started container of the runtime pool to the QE. From here on it is
+ * tracked by the aux process like a container created for the QE. Returns 1
+ * when the pool is empty, 0 once the container is handed over and -1 when it
+ * could not be registered, in which case it is gone.
+ */
+static int take_pooled_container(const char *runtimeid, const char *owner, ContainerKey *key, char *uds_address, char *container_id, char *log_msg)
+{
+	RuntimePool *pool;
+	PooledContainer *container;
+
+	if (runtime_pool_table == NULL)
+		return 1;
+	pool = (RuntimePool *) hash_search(runtime_pool_table, runtimeid, HASH_FIND, NULL);
+	if (pool == NULL || pool->nContainers == 0)
+		return 1;
+
+	container = &pool->containers[--pool->nContainers];
+	snprintf(uds_address, DEFAULT_STRING_BUFFER_SIZE, "%s", container->udsAddress);
+	snprintf(container_id, DEFAULT_STRING_BUFFER_SIZE, "%s", container->containerId);
+	if (report_container_created(key, runtimeid, owner, container_id) != 0) {
+		snprintf(log_msg, MAX_LOG_LENGTH, "failed to register pooled container %s", container_id);
+		return -1;
+	}
+	snprintf(log_msg, MAX_LOG_LENGTH, "container from pool, %d left", pool->nContainers);
+	return 0;
+}
+
+/*
+ * Fill the pools below their configured size. The containers are created and
+ * started by the server off the main thread, along with those started for
+ * QEs, and come back through finish_pool_container_start(). Pooled containers
+ * are created before any QE asks for them, so they carry no QE labels and get
+ * a socket directory of their own. Returns true while some pool waits to be
+ * refilled after a failed start.
+ */
+static bool refill_container_pools(PLCoordinatorServer *server)
+{
+	HASH_SEQ_STATUS hash_status;
+	runtimeConfEntry *conf_entry;
+	RuntimePool *pool;
+	TimestampTz now;
+	bool found;
+	bool short_pool = false;
+	char uds_dir[DEFAULT_STRING_BUFFER_SIZE];
+	int dbid = 0;
+
+	if (runtime_pool_table == NULL || runtime_conf_table == NULL)
+		return false;
+
+#ifndef PLC_PG
+	dbid = GpIdentity.dbid;
+#endif
+	now = GetCurrentTimestamp();
+	hash_seq_init(&hash_status, runtime_conf_table);
+	while ((conf_entry = (runtimeConfEntry *) hash_seq_search(&hash_status)) != NULL) {
+		if (conf_entry->poolSize <= 0)
+			continue;
+		pool = (RuntimePool *) hash_search(runtime_pool_table, conf_entry->runtimeid, HASH_ENTER, &found);
+		if (!found) {
+			pool->nContainers = 0;
+			pool->nStarting = 0;
+			pool->retryAfter = 0;
+		}
+		if (now < pool->retryAfter) {
+			short_pool = true;
+			continue;
+		}
+		while (pool->nContainers + pool->nStarting < conf_entry->poolSize) {
+			snprintf(uds_dir, sizeof(uds_dir), "%s.pool.%d.%d", UDS_PREFIX, ++pooled_container_seq, (int)getpid());
+			schedule_pool_container_start(server, conf_entry, uds_dir, dbid);
+			pool->nStarting++;
+		}
+	}
+	return short_pool;
+}
+
+/*
+ * Back on the main thread once a container of refill_container_pools() has
+ * been created and started, or failed to. res is 0 on success. A container
+ * started with an older runtime configuration or no longer needed is removed.
+ */
+void finish_pool_container_start(const char *runtimeid, uint32 generation, const char *container_id, const char *uds_dir, int res)
+{
+	runtimeConfEntry *conf_entry;
+	RuntimePool *pool = NULL;
+	PooledContainer *container;
+
+	if (runtime_pool_table != NULL)
+		pool = (RuntimePool *) hash_search(runtime_pool_table, runtimeid, HASH_FIND, NULL);
+	if (pool != NULL && pool->nStarting > 0)
+		pool->nStarting--;
 
-	res = plc_docker_start_container(docker_name);
 	if (res != 0) {
-		elog(WARNING, "start container failed");
+		elog(LOG, "failed to start pooled container of runtime %s", runtimeid);
+		if (pool != NULL)
+			pool->retryAfter = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), TIMEOUT_SEC * 1000L);
+		if (container_id[0] != '\0')
+			plc_docker_delete_container(container_id);
+		return;
+	}
+
+	conf_entry = plc_get_runtime_configuration(runtimeid);
+	if (pool == NULL || conf_entry == NULL || generation != plc_runtime_config_generation ||
+		pool->nContainers >= conf_entry->poolSize) {
+		elog(LOG, "remove pooled container %s of runtime %s, no longer needed", container_id, runtimeid);
+		plc_docker_delete_container(container_id);
+		return;
+	}
+	container = &pool->containers[pool->nContainers++];
+	snprintf(container->containerId, sizeof(container->containerId), "%s", container_id);
+	snprintf(container->udsAddress, sizeof(container->udsAddress), "%s/%s", uds_dir, UDS_SHARED_FILE);
+	elog(DEBUG1, "runtime %s has %d pooled containers", runtimeid, pool->nContainers);
+}
+
+/* Remove all pooled and reusable containers at once */
+static void drain_container_pools(void)
+{
+	HASH_SEQ_STATUS hash_status;
+	RuntimePool *pool;
+	ReusableContainers *reusable;
+	const char **ids;
+	char msg[DEFAULT_STRING_BUFFER_SIZE];
+	int n = 0;
+
+	if (runtime_pool_table == NULL || reusable_container_table == NULL)
+		return;
+
+	ids = palloc((hash_get_num_entries(runtime_pool_table) + hash_get_num_entries(reusable_container_table)) *
+				 PLC_MAX_POOL_SIZE * sizeof(char *) + sizeof(char *));
+	hash_seq_init(&hash_status, runtime_pool_table);
+	while ((pool = (RuntimePool *) hash_seq_search(&hash_status)) != NULL) {
+		while (pool->nContainers > 0) {
+			ids[n++] = pool->containers[--pool->nContainers].containerId;
+		}
+	}
+	hash_seq_init(&hash_status, reusable_container_table);
+	while ((reusable = (ReusableContainers *) hash_seq_search(&hash_status)) != NULL) {
+		while (reusable->nContainers > 0) {
+			ids[n++] = reusable->containers[--reusable->nContainers].containerId;
+		}
+	}
+	memset(msg, 0, sizeof(msg));
+	if (n > 0 && PlcDocker_delete(ids, n, msg) < 0)
+		elog(LOG, "failed to delete pooled containers: %s", msg);
+	pfree(ids);
+}
+
+static HTAB *init_reusable_container_table(void)
+{
+	HASHCTL hash_ctl;
+	memset(&hash_ctl, 0, sizeof(hash_ctl));
+	hash_ctl.keysize = sizeof(ReusableKey);
+	hash_ctl.entrysize = sizeof(ReusableContainers);
+	hash_ctl.hcxt = TopMemoryContext;
+	hash_ctl.hash = tag_hash;
+	return hash_create("reusable container hash",
+								MAX_EXPECTED_RUNTIME_NUM,
+								&hash_ctl,
+								HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+/* tag_hash covers the whole key, so the padding must be zeroed */
+static void make_reusable_key(ReusableKey *key, const char *runtimeid, const char *owner)
+{
+	memset(key, 0, sizeof(ReusableKey));
+	strlcpy(key->runtimeid, runtimeid, sizeof(key->runtimeid));
+	strlcpy(key->owner, owner, sizeof(key->owner));
+}
+
+/*
+ * Hand a container released by another QE of the same owner to the QE, the
+ * most recently released first. Like pooled containers, it is tracked by the
+ * aux process from here on. Returns like take_pooled_container().
+ */
+static int take_reusable_container(const char *runtimeid, const char *owner, ContainerKey *key, char *uds_address, char *container_id, char *log_msg)
+{
+	ReusableContainers *reusable;
+	ReusableKey reusable_key;
+	PooledContainer *container;
+
+	if (reusable_container_table == NULL || owner == NULL)
+		return 1;
+	make_reusable_key(&reusable_key, runtimeid, owner);
+	reusable = (ReusableContainers *) hash_search(reusable_container_table, &reusable_key, HASH_FIND, NULL);
+	if (reusable == NULL || reusable->nContainers == 0)
+		return 1;
+
+	container = &reusable->containers[--reusable->nContainers];
+	snprintf(uds_address, DEFAULT_STRING_BUFFER_SIZE, "%s", container->udsAddress);
+	snprintf(container_id, DEFAULT_STRING_BUFFER_SIZE, "%s", container->containerId);
+	if (report_container_created(key, runtimeid, owner, container_id) != 0) {
+		snprintf(log_msg, MAX_LOG_LENGTH, "failed to register reused container %s", container_id);
 		return -1;
 	}
+	snprintf(log_msg, MAX_LOG_LENGTH, "reused container, %d left", reusable->nContainers);
 	return 0;
 }
-int start_container(const char *runtimeid, pid_t qe_pid, int session_id, int ccnt, int dbid, const char *ownername, char **uds_address, char **container_id, char **log_msg)
+
+/*
+ * The part of starting a container for a QE that runs on the coordinator main
+ * thread. Returns 0 when the container is ready, i.e. in stand alone mode,
+ * released by a QE of the same owner or taken from the pool, 1 when it still has to be created and started in
+ * uds_dir with runtime_entry, which the server does off the main thread, and
+ * -1 on error.
+ */
+int prepare_container_start(const char *runtimeid, const char *owner, pid_t qe_pid, int session_id, int ccnt, char **uds_address, char **container_id, char **log_msg, struct runtimeConfEntry **runtime_entry, char **uds_dir)
 {
 	pid_t server_pid;
 	int res;
-	struct timeval create_start_time, create_end_time, start_end_time;
 	*uds_address = (char*) palloc(DEFAULT_STRING_BUFFER_SIZE);
 	*log_msg = (char*) palloc(MAX_LOG_LENGTH);
+	*container_id = (char *) palloc(DEFAULT_STRING_BUFFER_SIZE);
+	*log_msg[0] = '\0';
+	*runtime_entry = NULL;
+	*uds_dir = NULL;
 	ContainerKey key;
 	key.conn = session_id;
 	key.qe_pid = qe_pid;
@@ -526,58 +1111,112 @@ int start_container(const char *runtimeid, pid_t qe_pid, int session_id, int ccn
 	{
 		snprintf(*uds_address, DEFAULT_STRING_BUFFER_SIZE, "%s.%d.%d.%d.%d", DEBUG_UDS_PREFIX, qe_pid, session_id, ccnt, (int)getpid());
 		server_pid = start_stand_alone_process(*uds_address);
-		*container_id = (char *) palloc(DEFAULT_STRING_BUFFER_SIZE);
 		snprintf(*container_id, DEFAULT_STRING_BUFFER_SIZE, "standalone_pid_%d", server_pid);
-		store_container_info(&key, server_pid, NULL);
-		*log_msg[0] = '\0';
+		store_container_info(&key, server_pid, runtimeid, owner, *container_id);
 		return 0;
-	} else {
-		runtimeConfEntry *runtime_entry = plc_get_runtime_configuration(runtimeid);
-		if (runtime_entry == NULL) {
-			elog(WARNING, "Cannot find runtime configuration %s", runtimeid);
-			return -1;
-		}
-		char *uds_dir = palloc(DEFAULT_STRING_BUFFER_SIZE);
-		*container_id = (char *) palloc(DEFAULT_STRING_BUFFER_SIZE);
-		sprintf(uds_dir,  "%s.%d.%d.%d.%d", UDS_PREFIX, qe_pid, session_id, ccnt, (int)getpid());
-		snprintf(*uds_address, DEFAULT_STRING_BUFFER_SIZE, "%s/%s", uds_dir, UDS_SHARED_FILE);
-		int retry_count = 0;
-		bool created = false;
-		res = -1;
-		gettimeofday(&create_start_time, NULL);
-		char *msg = (char *) palloc(DEFAULT_STRING_BUFFER_SIZE);
-		memset(msg, 0 ,DEFAULT_STRING_BUFFER_SIZE);
-		while (retry_count < MAX_START_RETRY) {
-			if (!created) {
-				res = create_container(runtime_entry, &key, container_id, uds_dir,dbid, ownername);
-				
-				created = true;
-				gettimeofday(&create_end_time, NULL);
-				
-			}
+	}
 
-			res = PlcDocker_start(*container_id, msg);
-			if (res == 0) {
-				gettimeofday(&start_end_time, NULL);
-				break;
-			} else {
-				elog(LOG, "failed to start %s: %s", *container_id, msg);
-			}
-			retry_count++;
-			sleep(2);
-		}
-		pfree(msg);
-		int create_cost_time_ms = 0;
-		int start_cost_time_ms = 0;
-		if (res == 0) {
-			create_cost_time_ms = create_end_time.tv_sec * 1000 + create_end_time.tv_usec / 1000 
-						- create_start_time.tv_sec * 1000 - create_start_time.tv_usec / 1000;
-			start_cost_time_ms = start_end_time.tv_sec * 1000 + start_end_time.tv_usec / 1000 
-						- create_end_time.tv_sec * 1000 - create_end_time.tv_usec / 1000;
-			snprintf(*log_msg, MAX_LOG_LENGTH, "create cost: %d, start cost: %d, retry: %d", create_cost_time_ms, start_cost_time_ms, retry_count);
-		}
+	*runtime_entry = plc_get_runtime_configuration(runtimeid);
+	if (*runtime_entry == NULL) {
+		elog(WARNING, "Cannot find runtime configuration %s", runtimeid);
+		return -1;
+	}
+	res = take_reusable_container(runtimeid, owner, &key, *uds_address, *container_id, *log_msg);
+	if (res != 1) {
 		return res;
 	}
+	res = take_pooled_container(runtimeid, owner, &key, *uds_address, *container_id, *log_msg);
+	if (res != 1) {
+		return res;
+	}
+	*uds_dir = palloc(DEFAULT_STRING_BUFFER_SIZE);
+	snprintf(*uds_dir, DEFAULT_STRING_BUFFER_SIZE, "%s.%d.%d.%d.%d", UDS_PREFIX, qe_pid, session_id, ccnt, (int)getpid());
+	snprintf(*uds_address, DEFAULT_STRING_BUFFER_SIZE, "%s/%s", *uds_dir, UDS_SHARED_FILE);
+	return 1;
+}
+
+/*
+ * Back on the main thread once the container of prepare_container_start has
+ * been created and started, or failed to. res is 0 on success. Returns 0 when
+ * the container is registered for the QE, -1 when it is removed instead.
+ */
+int finish_container_start(const char *runtimeid, const char *owner, pid_t qe_pid, int session_id, int ccnt, const char *container_id, int res)
+{
+	ContainerKey key;
+	key.conn = session_id;
+	key.qe_pid = qe_pid;
+	key.ccnt = ccnt;
+
+	if (res == 0) {
+		return report_container_created(&key, runtimeid, owner, container_id) == 0 ? 0 : -1;
+	}
+	if (container_id[0] != '\0') {
+		/* created but never started, nobody else knows about it */
+		plc_docker_delete_container(container_id);
+	}
+	return -1;
+}
+
+/*
+ * A QE is done with its container. Returns 1 when the container is to be
+ * reset and kept for reuse, which the server asks the container for before
+ * finish_container_release(), 0 when it is destroyed instead and -1 on error.
+ * Containers started with an older runtime configuration are not reused.
+ */
+int prepare_container_release(const char *runtimeid, uint32 generation, pid_t qe_pid, int session_id, int ccnt, const char *container_id)
+{
+	ContainerKey key;
+	ContainerEntry *entry;
+	bool registered;
+
+	if (plcontainer_stand_alone_mode || !plc_reuse_containers || plc_max_reusable_containers <= 0 ||
+		generation != plc_runtime_config_generation || plc_get_runtime_configuration(runtimeid) == NULL)
+		return destroy_container(qe_pid, session_id, ccnt);
+
+	/*
+	 * Unregistered, the aux process no longer removes it once the QE exits.
+	 * One it is removing already is not reused.
+	 */
+	key.conn = session_id;
+	key.qe_pid = qe_pid;
+	key.ccnt = ccnt;
+	LWLockAcquire(coordinator_shm->registryLock, LW_EXCLUSIVE);
+	entry = (ContainerEntry *) hash_search(container_status_table, &key, HASH_FIND, NULL);
+	registered = entry != NULL && strcmp(entry->containerId, container_id) == 0;
+	if (registered)
+		unregister_container(entry);
+	LWLockRelease(coordinator_shm->registryLock);
+	return registered ? 1 : 0;
+}
+
+/*
+ * Back on the main thread once the released container answered ResetState,
+ * reset is false if it failed to. The container joins the reusable ones of its
+ * runtime and owner unless there are plcontainer.max_reusable_containers
+ * already, or the runtime configuration changed meanwhile.
+ */
+void finish_container_release(const char *runtimeid, const char *owner, uint32 generation, const char *container_id, const char *uds_address, bool reset)
+{
+	ReusableContainers *reusable;
+	ReusableKey key;
+	PooledContainer *container;
+	bool found;
+
+	if (reset && plc_reuse_containers && generation == plc_runtime_config_generation) {
+		make_reusable_key(&key, runtimeid, owner);
+		reusable = (ReusableContainers *) hash_search(reusable_container_table, &key, HASH_ENTER, &found);
+		if (!found)
+			reusable->nContainers = 0;
+		if (reusable->nContainers < plc_max_reusable_containers) {
+			container = &reusable->containers[reusable->nContainers++];
+			snprintf(container->containerId, sizeof(container->containerId), "%s", container_id);
+			snprintf(container->udsAddress, sizeof(container->udsAddress), "%s", uds_address);
+			elog(DEBUG1, "runtime %s has %d reusable containers of %s", runtimeid, reusable->nContainers, owner);
+			return;
+		}
+	}
+	elog(LOG, "remove released container %s", container_id);
+	plc_docker_delete_container(container_id);
 }
 
 int destroy_container(pid_t qe_pid, int session_id, int ccnt)
@@ -591,15 +1230,14 @@ int destroy_container(pid_t qe_pid, int session_id, int ccnt)
 		clear_container_info(&key);
 		return 0;
 	} else {
-		QeRequest *request;
+		QeRequest request;
 		int res;
-		request = (QeRequest*) palloc (sizeof(QeRequest));
-		memset(request, 0, sizeof(QeRequest));
-		request->pid = qe_pid;
-		request->conn = session_id;
-		request->ccnt = ccnt;
-		request->requestType = DESTROY_SERVER;
-		res = send_message(request);
+		memset(&request, 0, sizeof(QeRequest));
+		request.pid = qe_pid;
+		request.conn = session_id;
+		request.ccnt = ccnt;
+		request.requestType = DESTROY_SERVER;
+		res = send_message(&request);
 		if (res != 0)
 		{
 			elog(WARNING, "send destroy message for qe %d failure", qe_pid);
@@ -611,118 +1249,394 @@ int destroy_container(pid_t qe_pid, int session_id, int ccnt)
 	}
 }
 
+/*
+ * Queue a request for the aux process without waiting, see QeRequestRing.
+ * Returns -1 if the ring is full, the aux process then learns about the QE
+ * or the container on its next inspection.
+ */
 static int send_message(QeRequest *request)
 {
-	shm_mq_result res;
+	QeRequestSlot *slot;
+	uint64 pos;
+	uint64 sequence;
+	Latch *consumer;
 
-	/* Must wait if the message queue is full */
-	res = shm_mq_send(message_queue_handle, sizeof(QeRequest), request, false);
-	if (res != SHM_MQ_SUCCESS)
+	pos = __atomic_load_n(&request_ring->head, __ATOMIC_RELAXED);
+	for (;;)
 	{
-		return -1;
-	} else {
-		return 0;
+		slot = &request_ring->slots[pos & (QE_REQUEST_RING_SIZE - 1)];
+		sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if (sequence == pos) {
+			/* on failure pos is reloaded with the current head */
+			if (__atomic_compare_exchange_n(&request_ring->head, &pos, pos + 1, true,
+											__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if ((int64) (sequence - pos) < 0) {
+			/* the slot still holds the request sent one lap ago */
+			return -1;
+		} else {
+			pos = __atomic_load_n(&request_ring->head, __ATOMIC_RELAXED);
+		}
 	}
+	slot->request = *request;
+	__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+	consumer = __atomic_load_n(&request_ring->consumer, __ATOMIC_ACQUIRE);
+	if (consumer != NULL)
+		SetLatch(consumer);
+	return 0;
 }
 
 static int receive_message()
 {
-	shm_mq_result res;
-	Size nbytes;
-	void *data;
-	int result = 0;
+	QeRequestSlot *slot;
+	QeRequest request;
+	uint64 pos;
+
 	for (;;)
 	{
-		/* Receive does not need to be blocked */
-		res = shm_mq_receive(message_queue_handle, &nbytes, &data, true);
-
-		if (res == SHM_MQ_WOULD_BLOCK)
-		{
+		pos = request_ring->tail;
+		slot = &request_ring->slots[pos & (QE_REQUEST_RING_SIZE - 1)];
+		/* empty, or the producer of pos has not filled the slot yet */
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != pos + 1)
 			break;
-		} else if (res == SHM_MQ_SUCCESS) {
-			if (nbytes == sizeof(QeRequest))
-			{
-				QeRequest *request;
-
-				request = (QeRequest*) data;
-				elog(LOG, "PLC coordinator: receive message %d.%d --- %s", request->pid, request->conn, request->containerId);
-				handle_request(request);
+		request = slot->request;
+		__atomic_store_n(&slot->sequence, pos + QE_REQUEST_RING_SIZE, __ATOMIC_RELEASE);
+		request_ring->tail = pos + 1;
+
+		elog(LOG, "PLC coordinator: receive message %d.%d --- %s", request.pid, request.conn, request.containerId);
+		handle_request(&request);
+	}
+	return 0;
+}
+
+/*
+ * Remove the containers of exited QEs and, if inspect, the exited containers.
+ * The QEs are polled unless their exits are watched, see handle_qe_exits().
+ */
+static int update_containers_status(bool inspect)
+{
+	bool qe_exited;
+	int entry_num;
+	int ninspect = 0;
+	int nremove = 0;
+	int n = 0;
+	int i;
+	ContainerEntry *container_entry;
+	ContainerEntry *entries;
+	ContainerEntry **inspect_entries;
+	ContainerEntry **remove_entries;
+	const char **ids;
+
+	/* work on a copy, the registry is not locked while docker is asked */
+	entry_num = copy_container_registry(&entries);
+	if (entry_num == 0) {
+		pfree(entries);
+		return 0;
+	}
+
+	inspect_entries = palloc(entry_num * sizeof(ContainerEntry *));
+	remove_entries = palloc(entry_num * sizeof(ContainerEntry *));
+	ids = palloc(entry_num * sizeof(char *));
+	for (i = 0; i < entry_num; i++) {
+		container_entry = &entries[i];
+		if (plcontainer_stand_alone_mode) {
+			if (kill(container_entry->key.qe_pid, 0) != 0)
+				destroy_container(container_entry->key.qe_pid, container_entry->key.conn, container_entry->key.ccnt);
+			continue;
+		}
+		/* check process first */
+		qe_exited = !qe_exit_watched && kill(container_entry->key.qe_pid, 0) != 0;
+		if (qe_exited) {
+			elog(LOG, "delete container %s of pid %d session id %d ccnt %d", container_entry->containerId, container_entry->key.qe_pid, container_entry->key.conn, container_entry->key.ccnt);
+			remove_entries[nremove++] = container_entry;
+		} else if (inspect && container_entry->containerId[0] != '\0') {
+			inspect_entries[ninspect++] = container_entry;
+		}
+	}
+	if (ninspect > 0) {
+		int *exited = palloc(ninspect * sizeof(int));
+
+		for (i = 0; i < ninspect; i++)
+			ids[i] = inspect_entries[i]->containerId;
+		PlcDocker_inspect_exited(ids, ninspect, exited);
+		for (i = 0; i < ninspect; i++) {
+			if (exited[i] < 0) {
+				elog(LOG, "Failed to inspect container %s", inspect_entries[i]->containerId);
+			} else if (exited[i] > 0) {
+				remove_entries[nremove++] = inspect_entries[i];
 			}
+		}
+		pfree(exited);
+	}
+
+	/* unregister first, containers released or replaced meanwhile are kept */
+	if (nremove > 0) {
+		LWLockAcquire(coordinator_shm->registryLock, LW_EXCLUSIVE);
+		for (i = 0; i < nremove; i++) {
+			container_entry = (ContainerEntry *) hash_search(container_status_table, &remove_entries[i]->key, HASH_FIND, NULL);
+			if (container_entry == NULL || strcmp(container_entry->containerId, remove_entries[i]->containerId) != 0)
+				continue;
+			unregister_container(container_entry);
+			ids[n++] = remove_entries[i]->containerId;
+		}
+		LWLockRelease(coordinator_shm->registryLock);
+	}
+	if (n > 0) {
+		char *msg = (char *) palloc0(DEFAULT_STRING_BUFFER_SIZE);
+		if (PlcDocker_delete(ids, n, msg) < 0) {
+			elog(LOG, "delete failed %s", msg);
 		} else {
-			elog(LOG, "PLC coordinator: mq res %d", res);
-			result = -1;
-			break;
+			elog(LOG, "success delete %d containers", n);
 		}
+		pfree(msg);
 	}
-	return result;
+	pfree(entries);
+	pfree(inspect_entries);
+	pfree(remove_entries);
+	pfree(ids);
+	return 0;
 }
-static int update_containers_status(bool inspect)
+
+static int open_container_events(long since)
 {
-    int entry_num = 0;
-    int res = 0;
-    int i = 0;
-    entry_num = hash_get_num_entries(container_status_table);
-    if (entry_num == 0) {
-        return 0;
-    }
-    HASH_SEQ_STATUS scan;
-    ContainerEntry *container_entry = NULL;
-    hash_seq_init(&scan, container_status_table);
-	int entry_size = entry_num * sizeof(ContainerKey *);
-    ContainerKey **entry_array = palloc(entry_size);
-	memset(entry_array, 0, entry_size);
-	int delete_ids_size = entry_num * sizeof(char*);
-	char **delete_ids = palloc(delete_ids_size);
-	memset(delete_ids, 0, delete_ids_size);
-	while ((container_entry = (ContainerEntry *) hash_seq_search(&scan)) != NULL) {
-        if (!plcontainer_stand_alone_mode) {
-			/* check process first */
-            res = kill(container_entry->key.qe_pid, 0);
-            if (res != 0 ) {
-                elog(LOG, "delete container %s of pid %d session id %d ccnt %d", container_entry->containerId, container_entry->key.qe_pid, container_entry->key.conn, container_entry->key.ccnt);
-				entry_array[i] = &(container_entry->key);
-				delete_ids[i] = &(container_entry->containerId);
-				i++;
-				continue;
-            }
-			
-			if (inspect) {
-				res = plc_docker_inspect_container(container_entry->containerId, &container_entry->status, PLC_INSPECT_STATUS);
-				if (res < 0) {
-					elog(LOG, "Failed to inspect container %s", container_entry->containerId);
-					continue;
-				}
-				if (strcmp(container_entry->status, "exited") == 0) {
-					//plc_docker_delete_container(container_entry->containerId);
-					delete_ids[i] = &(container_entry->containerId);
-					entry_array[i] = &(container_entry->key);
-					i++;
-				}
-			}
-        } else {
-            if (kill(container_entry->key.qe_pid, 0) != 0) {
-                destroy_container(container_entry->key.qe_pid, container_entry->key.conn, container_entry->key.ccnt);
-                entry_array[i++] = &(container_entry->key);
-            }
-        }
+	int dbid = 0;
+	int sock;
+
+#ifndef PLC_PG
+	dbid = GpIdentity.dbid;
+#endif
+	sock = PlcDocker_events_open(dbid, since);
+	if (sock < 0) {
+		elog(LOG, "PLC coordinator: failed to subscribe to docker events, inspecting containers instead");
+		return -1;
+	}
+	if (aux_epfd >= 0) {
+		struct epoll_event event;
+
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.u64 = 0;	/* pidfds carry their pid */
+		if (epoll_ctl(aux_epfd, EPOLL_CTL_ADD, sock, &event) < 0)
+			elog(LOG, "PLC coordinator: failed to wait for docker events: %m");
+	}
+	return sock;
+}
+
+static int
+plc_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return (int) syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void init_qe_exit_watch(void)
+{
+	HASHCTL hash_ctl;
+	int fd;
+
+	aux_epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (aux_epfd < 0)
+		elog(ERROR, "failed to create epoll fd: %m");
+
+	memset(&hash_ctl, 0, sizeof(hash_ctl));
+	hash_ctl.keysize = sizeof(pid_t);
+	hash_ctl.entrysize = sizeof(QeProcess);
+	hash_ctl.hcxt = CurrentMemoryContext;
+	hash_ctl.hash = tag_hash;
+	qe_process_table = hash_create("qe process hash", 64, &hash_ctl,
+								   HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	fd = plc_pidfd_open(getpid());
+	if (fd < 0) {
+		elog(LOG, "PLC coordinator: pidfd_open is not supported, polling QEs instead: %m");
+		return;
+	}
+	close(fd);
+	qe_exit_watched = true;
+}
+
+/*
+ * Remember the container of key for its QE, and be woken up once the QE
+ * exits, see handle_qe_exits()
+ */
+static void watch_qe_exit(ContainerKey *key)
+{
+	struct epoll_event event;
+	MemoryContext oldcontext;
+	ListCell *lc;
+	ContainerKey *copy;
+	QeProcess *qe;
+	pid_t qe_pid = key->qe_pid;
+	bool found;
+	int pidfd;
+
+	if (!qe_exit_watched)
+		return;
+	qe = (QeProcess *) hash_search(qe_process_table, &qe_pid, HASH_ENTER, &found);
+	if (!found) {
+		qe->pidfd = -1;
+		qe->polled = false;
+		qe->keys = NIL;
+	}
+	foreach(lc, qe->keys) {
+		if (memcmp(lfirst(lc), key, sizeof(ContainerKey)) == 0)
+			break;
+	}
+	if (lc == NULL) {
+		oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+		copy = palloc(sizeof(ContainerKey));
+		*copy = *key;
+		qe->keys = lappend(qe->keys, copy);
+		MemoryContextSwitchTo(oldcontext);
 	}
-	if (i > 0 && !plcontainer_stand_alone_mode) {
-		char *msg = (char *) palloc(DEFAULT_STRING_BUFFER_SIZE);
-		memset(msg, 0 ,DEFAULT_STRING_BUFFER_SIZE);
-		int res = PlcDocker_delete((const char**)delete_ids, i, msg);
-		if (res < 0) {
+	if (found)
+		return;
+	pidfd = plc_pidfd_open(qe_pid);
+	if (pidfd < 0) {
+		/* already gone, the containers go with the next handle_qe_exits() */
+		if (errno == ESRCH)
+			return;
+		/* e.g. out of fds, the aux process must not exit for that */
+		elog(LOG, "PLC coordinator: failed to watch QE %d, polling it instead: %m", qe_pid);
+		qe->polled = true;
+		qe_polled++;
+		return;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = (uint64) qe_pid;
+	if (epoll_ctl(aux_epfd, EPOLL_CTL_ADD, pidfd, &event) < 0) {
+		elog(LOG, "PLC coordinator: failed to watch QE %d, polling it instead: %m", qe_pid);
+		close(pidfd);
+		qe->polled = true;
+		qe_polled++;
+		return;
+	}
+	qe->pidfd = pidfd;
+}
+
+/* Remove the containers of the QEs that exited since the last call */
+static void handle_qe_exits(void)
+{
+	struct epoll_event events[MAX_EXITED_QES];
+	HASH_SEQ_STATUS scan;
+	QeProcess *qe;
+	pid_t exited[MAX_EXITED_QES];
+	int nexited = 0;
+	int n;
+	int i;
+
+	if (!qe_exit_watched)
+		return;
+
+	/* QEs that were gone before they could be watched, or polled ones gone since */
+	hash_seq_init(&scan, qe_process_table);
+	while ((qe = (QeProcess *) hash_seq_search(&scan)) != NULL) {
+		if (qe->pidfd >= 0 || nexited >= MAX_EXITED_QES)
+			continue;
+		if (!qe->polled || (kill(qe->qe_pid, 0) != 0 && errno == ESRCH))
+			exited[nexited++] = qe->qe_pid;
+	}
+
+	n = epoll_wait(aux_epfd, events, MAX_EXITED_QES - nexited, 0);
+	for (i = 0; i < n; i++) {
+		if (events[i].data.u64 != 0)
+			exited[nexited++] = (pid_t) events[i].data.u64;
+	}
+
+	for (i = 0; i < nexited; i++) {
+		qe = (QeProcess *) hash_search(qe_process_table, &exited[i], HASH_FIND, NULL);
+		if (qe == NULL)
+			continue;
+		/* closing the pidfd also removes it from aux_epfd */
+		if (qe->pidfd >= 0)
+			close(qe->pidfd);
+		if (qe->polled)
+			qe_polled--;
+		remove_qe_containers(qe);
+		hash_search(qe_process_table, &exited[i], HASH_REMOVE, NULL);
+	}
+}
+
+/* Unregister and remove the containers still registered for the exited qe */
+static void remove_qe_containers(QeProcess *qe)
+{
+	ContainerEntry *entry;
+	ListCell *lc;
+	char **ids;
+	int n = 0;
+	int i;
+
+	if (qe->keys == NIL)
+		return;
+	ids = palloc(list_length(qe->keys) * sizeof(char *));
+	LWLockAcquire(coordinator_shm->registryLock, LW_EXCLUSIVE);
+	foreach(lc, qe->keys) {
+		entry = (ContainerEntry *) hash_search(container_status_table, lfirst(lc), HASH_FIND, NULL);
+		if (entry == NULL)
+			continue;
+		elog(LOG, "delete container %s of pid %d session id %d ccnt %d", entry->containerId, entry->key.qe_pid, entry->key.conn, entry->key.ccnt);
+		if (entry->containerId[0] != '\0')
+			ids[n++] = pstrdup(entry->containerId);
+		unregister_container(entry);
+	}
+	LWLockRelease(coordinator_shm->registryLock);
+	if (n > 0) {
+		char *msg = (char *) palloc0(DEFAULT_STRING_BUFFER_SIZE);
+		if (PlcDocker_delete((const char **) ids, n, msg) < 0) {
 			elog(LOG, "delete failed %s", msg);
 		} else {
-			elog(LOG, "success delete %d containers", i);
+			elog(LOG, "success delete %d containers", n);
 		}
 		pfree(msg);
 	}
-	for (int j = 0; j < i; j++) {
-		hash_search(container_status_table, entry_array[j], HASH_REMOVE, NULL);
+	for (i = 0; i < n; i++)
+		pfree(ids[i]);
+	pfree(ids);
+	list_free_deep(qe->keys);
+	qe->keys = NIL;
+}
+
+/*
+ * Forget the containers that exited or were removed outside of the
+ * coordinator, and remove the exited ones. Returns -1 once the event stream
+ * is closed.
+ */
+static int handle_container_events(void)
+{
+	ContainerEvent events[MAX_CONTAINER_EVENTS];
+	ContainerIdEntry *id_entry;
+	ContainerEntry *entry = NULL;
+	ContainerEntry removed;
+	int n;
+	int i;
+
+	while ((n = PlcDocker_events_read(events, MAX_CONTAINER_EVENTS)) > 0) {
+		for (i = 0; i < n; i++) {
+			LWLockAcquire(coordinator_shm->registryLock, LW_EXCLUSIVE);
+			id_entry = (ContainerIdEntry *) hash_search(container_id_index, events[i].containerId, HASH_FIND, NULL);
+			if (id_entry != NULL)
+				entry = (ContainerEntry *) hash_search(container_status_table, &id_entry->key, HASH_FIND, NULL);
+			/* pooled containers, or ones the coordinator removed itself */
+			if (id_entry == NULL || entry == NULL || strcmp(entry->containerId, events[i].containerId) != 0) {
+				LWLockRelease(coordinator_shm->registryLock);
+				continue;
+			}
+			removed = *entry;
+			unregister_container(entry);
+			LWLockRelease(coordinator_shm->registryLock);
+			elog(LOG, "container %s of pid %d session id %d ccnt %d %s", removed.containerId,
+				 removed.key.qe_pid, removed.key.conn, removed.key.ccnt, events[i].destroyed ? "removed" : "exited");
+			if (!events[i].destroyed)
+				plc_docker_delete_container(removed.containerId);
+		}
 	}
-	pfree(entry_array);
-	pfree(delete_ids);
-    return 0;
+	return n;
 }
 
 static int handle_request(QeRequest *req)
@@ -734,7 +1648,8 @@ static int handle_request(QeRequest *req)
 	key->ccnt = req->ccnt;
 	switch (req->requestType) {
 		case CREATE_SERVER:
-			store_container_info(key, 0, req->containerId);
+			/* registered by the main process already */
+			watch_qe_exit(key);
 			break;
 		case DESTROY_SERVER:
 			clear_container_info(key);
@@ -758,85 +1673,18 @@ static int start_stand_alone_process(const char* uds_address)
 	return pid;
 }
 
-static void shm_message_queue_receiver_init(dsm_segment *seg)
+static Size request_ring_size(void)
 {
-	shm_toc    *toc;
-	shm_mq *message_queue;
-
-
-	if (seg == NULL)
-		elog(ERROR, "unable to map dynamic shared memory segment");
-
-	toc = shm_toc_attach(PLC_COORDINATOR_MAGIC_NUMBER, dsm_segment_address(seg));
-	if (toc == NULL)
-		elog(ERROR, "bad magic number in dynamic shared memory segment");
-
-	/* Using key 0 to connect global message queue status */
-	message_queue_status = shm_toc_lookup(toc, 0);
-	SpinLockAcquire(&message_queue_status->mutex);
-	if (message_queue_status->state != CO_STATE_BUFFER_INITIALIZED) {
-		SpinLockRelease(&message_queue_status->mutex);
-		elog(ERROR, "message queue is not ready");
-	}
-	message_queue_status->state = CO_STATE_BUFFER_ATTACHED;
-	SpinLockRelease(&message_queue_status->mutex);
-
-	/* get the message queue with key 1 */
-	message_queue = shm_toc_lookup(toc, 1);
-
-	shm_mq_set_receiver(message_queue, MyProc);
-	message_queue_handle = shm_mq_attach(message_queue, seg, NULL);
-
+	return MAXALIGN(offsetof(QeRequestRing, slots) + sizeof(QeRequestSlot) * QE_REQUEST_RING_SIZE);
 }
 
-static dsm_handle shm_message_queue_sender_init()
+static void init_request_ring(void)
 {
-	shm_toc_estimator e;
-	Size segsize;
-	dsm_segment *seg;
-	shm_toc    *toc;
-	Size buffersize;
-	shm_mq *message_queue;
-
-	/* Calculate how many memory that needed allocated for message queue
-	 * In message queue, we have two keys, one key is for message queue status
-	 * another key is for queue buffer
-	 */
-	shm_toc_initialize_estimator(&e);
-
-	/* size of message queue status */
-	shm_toc_estimate_chunk(&e, sizeof(ShmqBufferStatus));
-	shm_toc_estimate_keys(&e, 1);
-
-	/* size of queue buffer */
-	buffersize = sizeof(QeRequest) * SHMQ_BUFFER_BLOCK_NUMBER;
-	shm_toc_estimate_chunk(&e, buffersize);
-	shm_toc_estimate_keys(&e, 1);
-
-	segsize = shm_toc_estimate(&e);
-
-	/* Create the shared memory segment and establish a table of contents. */
-	CurrentResourceOwner = ResourceOwnerCreate(NULL, "plcontainer coordinator");
-	seg = dsm_create(shm_toc_estimate(&e));
-	toc = shm_toc_create(PLC_COORDINATOR_MAGIC_NUMBER, dsm_segment_address(seg),
-						 segsize);
-
-	/* Set up the message queue status region. */
-	message_queue_status = shm_toc_allocate(toc, sizeof(ShmqBufferStatus));
-	SpinLockInit(&message_queue_status->mutex);
-	message_queue_status->state = CO_STATE_BUFFER_INITIALIZED;
-
-	/* The first content with key id 0 */
-	shm_toc_insert(toc, 0, message_queue_status);
-
-	/* Create message queue with key id 1 */
-	message_queue = shm_mq_create(shm_toc_allocate(toc, buffersize),
-						   buffersize);
-	shm_toc_insert(toc, 1, message_queue);
-
-	/* Main process is sender */
-	shm_mq_set_sender(message_queue, MyProc);
-	message_queue_handle = shm_mq_attach(message_queue, seg, NULL);
+	uint64 pos;
 
-	return dsm_segment_handle(seg);
+	request_ring->head = 0;
+	request_ring->tail = 0;
+	request_ring->consumer = NULL;
+	for (pos = 0; pos < QE_REQUEST_RING_SIZE; pos++)
+		request_ring->slots[pos].sequence = pos;
 }
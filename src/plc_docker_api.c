@@ -31,6 +31,12 @@ static char *plc_docker_url_prefix = "http:/v1.27";
 static char *default_log_dirver = "journald";
 char backend_error_message[256];
 
+/*
+ * Kept across calls, so its connection to the Docker socket stays open and
+ * the next call skips the setup of a new handle.
+ */
+static CURL *plc_curl_handle = NULL;
+
 /* Static functions of the Docker API module */
 static plcCurlBuffer *plcCurlBufferInit();
 
@@ -96,7 +102,9 @@ static plcCurlBuffer *plcCurlRESTAPICall(plcCurlCallType cType,
 
 	memset(errbuf, 0, CURL_ERROR_SIZE);
 
-	curl = curl_easy_init();
+	if (plc_curl_handle == NULL)
+		plc_curl_handle = curl_easy_init();
+	curl = plc_curl_handle;
 
 	if (curl) {
 		char *fullurl;
@@ -193,7 +201,8 @@ static plcCurlBuffer *plcCurlRESTAPICall(plcCurlCallType cType,
 cleanup:
 		pfree(fullurl);
 		curl_slist_free_all(headers);
-		curl_easy_cleanup(curl);
+		/* errbuf and headers go away, the handle must not point to them */
+		curl_easy_reset(curl);
 	} else {
 		snprintf(backend_error_message, sizeof(backend_error_message),
 		         "Failed to start a curl session for unknown reason");
@@ -344,6 +344,11 @@ static char *plc_datum_as_float8_numeric(Datum input, pg_attribute_unused() plcT
 	return out;
 }
 
+/* Numeric as is, in the binary format of numeric_send */
+char *plc_datum_as_numeric_binary(Datum input, pg_attribute_unused() plcTypeInfo *type) {
+	return (char *) DatumGetByteaP(DirectFunctionCall1(numeric_send, input));
+}
+
 static char *plc_datum_as_text(Datum input, plcTypeInfo *type) {
 	return DatumGetCString(OidFunctionCall3(type->output,
 	                                        input,
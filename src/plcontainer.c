@@ -6,6 +6,7 @@
 
 /* Postgres Headers */
 #include "postgres.h"
+#include "access/xact.h"
 #include "utils/builtins.h"
 #include "utils/syscache.h"
 #include "catalog/pg_proc.h"
@@ -14,6 +15,7 @@
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 #endif
 #include "commands/trigger.h"
+#include "executor/executor.h"
 #include "executor/spi.h"
 #ifdef PLC_PG
 #pragma GCC diagnostic pop
@@ -53,6 +55,15 @@ static void plpython_error_callback(void *arg);
 
 static char * PLy_procedure_name(plcProcInfo *proc);
 
+static void plcontainer_xact_callback(XactEvent event, void *arg);
+
+static void plcontainer_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+										 SubTransactionId parentSubid, void *arg);
+
+static void plcontainer_executor_finish(QueryDesc *queryDesc);
+
+static ExecutorFinish_hook_type prev_ExecutorFinish = NULL;
+
 /*
  * Currently active plpython function
  */
@@ -77,9 +88,61 @@ _PG_init(void) {
 	if (inited)
 		return;
 
+	RegisterXactCallback(plcontainer_xact_callback, NULL);
+	RegisterSubXactCallback(plcontainer_subxact_callback, NULL);
+
+	prev_ExecutorFinish = ExecutorFinish_hook;
+	ExecutorFinish_hook = plcontainer_executor_finish;
+
 	inited = true;
 }
 
+/*
+ * Batched calls of void functions are only shipped when the batch is full,
+ * make sure the remaining rows run before the transaction commits.
+ */
+static void
+plcontainer_xact_callback(XactEvent event, pg_attribute_unused() void *arg) {
+	switch (event) {
+		case XACT_EVENT_PRE_COMMIT:
+		case XACT_EVENT_PRE_PREPARE:
+			plcontainer_flush_batch();
+			break;
+		case XACT_EVENT_ABORT:
+			plcontainer_discard_batch();
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Rows buffered within a subtransaction that is rolled back must not run once
+ * it is gone, e.g. at the commit of the enclosing transaction.
+ */
+static void
+plcontainer_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+							 pg_attribute_unused() SubTransactionId parentSubid, pg_attribute_unused() void *arg) {
+	if (event == SUBXACT_EVENT_ABORT_SUB)
+		plcontainer_discard_subxact_batch(mySubid);
+}
+
+/*
+ * Run the rows still buffered once the statement that called the function has
+ * finished, so their errors are raised by that statement and not by a later
+ * one or the commit. ExecutorFinish may fail like the AFTER triggers it fires,
+ * unlike ExecutorEnd which only releases the executor's resources.
+ */
+static void
+plcontainer_executor_finish(QueryDesc *queryDesc) {
+	if (prev_ExecutorFinish)
+		prev_ExecutorFinish(queryDesc);
+	else
+		standard_ExecutorFinish(queryDesc);
+
+	plcontainer_flush_batch();
+}
+
 static bool
 PLy_procedure_is_trigger(Form_pg_proc procStruct)
 {
@@ -1,15 +1,88 @@
 #include "async_server.h"
+#include "proto_utils.h"
+#include "docker/plc_docker.h"
+
+#define MAX_START_RETRY 5
+#define RESET_STATE_TIMEOUT_SEC 10
 
 // Base class used to cast the void* tags we get from the completion queue and call Proceed() on them.
 class Call {
 public:
+    virtual ~Call() {}
     virtual void Proceed(bool ok) = 0;
 };
 
-class StartContainerCall final : public Call {
+/*
+ * A container created and started on a worker thread, see
+ * AsyncServer::ScheduleContainerStart(). param_ is filled on the main thread
+ * beforehand, Proceed() is called back on it once the worker is done.
+ */
+class ContainerStart : public Call {
 public:
-    explicit StartContainerCall(PLCoordinator::AsyncService* service, grpc::ServerCompletionQueue* cq)
-        : service_(service), cq_(cq), responder_(&ctx_), status_(REQUEST) {
+    ContainerStart(AsyncServer* server, grpc::CompletionQueue* cq)
+        : server_(server), result_(-1), startCq_(cq) {}
+
+    void StartWorker() {
+        worker_ = std::thread(&ContainerStart::createContainer, this);
+    }
+
+protected:
+    // back on the main thread, lets the next waiting container start
+    void workerDone() {
+        worker_.join();
+        server_->ContainerStartDone();
+    }
+
+    AsyncServer* server_;
+    JSON_DOC param_;
+    std::string containerId_;
+    std::string message_;
+    int result_;
+
+private:
+    /*
+     * Runs on the worker thread, so it must not call into the backend: no
+     * elog, no palloc. The alarm hands the call back to the main thread.
+     */
+    void createContainer() {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point created, started;
+        int retry_count = 0;
+
+        result_ = -1;
+        containerId_ = PlcDocker::create(param_);
+        created = std::chrono::steady_clock::now();
+        if (containerId_.empty()) {
+            message_ = "create container failed";
+        } else {
+            while (retry_count < MAX_START_RETRY) {
+                message_.clear();
+                result_ = PlcDocker::start(containerId_, message_);
+                if (result_ == 0) {
+                    break;
+                }
+                retry_count++;
+                sleep(2);
+            }
+        }
+        started = std::chrono::steady_clock::now();
+        if (result_ == 0) {
+            message_ = "create cost: " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(created - begin).count()) +
+                       ", start cost: " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(started - created).count()) +
+                       ", retry: " + std::to_string(retry_count);
+        }
+        alarm_.Set(startCq_, std::chrono::system_clock::now(), this);
+    }
+
+    grpc::CompletionQueue* startCq_;
+    std::thread worker_;
+    grpc::Alarm alarm_;
+};
+
+class StartContainerCall final : public ContainerStart {
+public:
+    explicit StartContainerCall(AsyncServer* server, PLCoordinator::AsyncService* service, grpc::ServerCompletionQueue* cq)
+        : ContainerStart(server, cq), service_(service), cq_(cq), responder_(&ctx_), status_(REQUEST) {
         service_->RequestStartContainer(&ctx_, &request_, &responder_, cq_, cq_, this);
     }
 
@@ -17,7 +90,7 @@ public:
         int ret;
         switch (status_) {
         case REQUEST:
-            new StartContainerCall(service_, cq_);
+            new StartContainerCall(server_, service_, cq_);
             if (!ok) {
                 responder_.FinishWithError(grpc::Status::CANCELLED, this);
                 plc_elog(WARNING, "StartContainer request is not ok. Finishing.");
@@ -25,7 +98,23 @@ public:
                 char *uds_address;
                 char *container_id;
                 char *log_msg;
-                ret = start_container(request_.runtime_id().c_str(), (pid_t)request_.qe_pid(), request_.session_id(), request_.command_count(), request_.dbid(), request_.ownername().c_str(), &uds_address, &container_id, &log_msg);
+                char *uds_dir;
+                runtimeConfEntry *runtime_entry;
+                response_.set_generation(plc_runtime_config_generation);
+                ret = prepare_container_start(request_.runtime_id().c_str(), request_.ownername().c_str(), (pid_t)request_.qe_pid(), request_.session_id(), request_.command_count(), &uds_address, &container_id, &log_msg, &runtime_entry, &uds_dir);
+                if (ret == 1) {
+                    // docker create and start are left to a worker thread
+                    PlcDocker::create_param(param_, runtime_entry, std::string(uds_dir), request_.qe_pid(), request_.session_id(), request_.command_count(),
+                                            getuid(), getgid(), MyProcPid, request_.dbid(), request_.ownername());
+                    response_.set_container_address(uds_address);
+                    pfree(uds_address);
+                    pfree(container_id);
+                    pfree(log_msg);
+                    pfree(uds_dir);
+                    status_ = CREATE;
+                    server_->ScheduleContainerStart(this);
+                    break;
+                }
                 if (ret == 0) {
                     response_.set_container_address(uds_address);
                     response_.set_container_id(container_id);
@@ -36,10 +125,34 @@ public:
                 pfree(uds_address);
                 pfree(container_id);
                 pfree(log_msg);
-                plc_elog(DEBUG1, "StartContainer request successfully. request:%s response:%s",
-                        request_.DebugString().c_str(),
-                        response_.DebugString().c_str());
+                plc_elog_lazy(DEBUG1, "StartContainer request successfully. request:%s response:%s",
+                        PLContainerProtoUtils::TracePayload(request_).c_str(),
+                        PLContainerProtoUtils::TracePayload(response_).c_str());
+            }
+            status_ = FINISH;
+            break;
+
+        case CREATE:
+            workerDone();
+            if (finish_container_start(request_.runtime_id().c_str(), request_.ownername().c_str(), (pid_t)request_.qe_pid(),
+                                       request_.session_id(), request_.command_count(), containerId_.c_str(), result_) != 0 &&
+                result_ == 0) {
+                // started, but removed again as it could not be registered
+                result_ = -1;
+                message_ = "failed to register container " + containerId_;
+            }
+            if (result_ == 0) {
+                response_.set_container_id(containerId_);
+            } else {
+                response_.clear_container_address();
+                plc_elog(WARNING, "failed to start container for qe %d: %s", request_.qe_pid(), message_.c_str());
             }
+            response_.set_status(result_);
+            response_.set_log_msg(message_);
+            responder_.Finish(response_, grpc::Status::OK, this);
+            plc_elog_lazy(DEBUG1, "StartContainer request successfully. request:%s response:%s",
+                    PLContainerProtoUtils::TracePayload(request_).c_str(),
+                    PLContainerProtoUtils::TracePayload(response_).c_str());
             status_ = FINISH;
             break;
 
@@ -59,10 +172,32 @@ private:
     grpc::ServerAsyncResponseWriter<StartContainerResponse> responder_;
     StartContainerRequest request_;
     StartContainerResponse response_;
-    enum CallStatus { REQUEST, FINISH };
+    enum CallStatus { REQUEST, CREATE, FINISH };
     CallStatus status_;
 };
 
+// a container started for the pool of a runtime, see refill_container_pools()
+class PoolContainerStart final : public ContainerStart {
+public:
+    PoolContainerStart(AsyncServer* server, grpc::CompletionQueue* cq, runtimeConfEntry *conf, const char *uds_dir, int dbid)
+        : ContainerStart(server, cq), runtimeId_(conf->runtimeid), udsDir_(uds_dir), generation_(plc_runtime_config_generation) {
+        // pooled containers carry no QE labels until a QE takes them
+        PlcDocker::create_param(param_, conf, udsDir_, 0, 0, 0, getuid(), getgid(), MyProcPid, dbid, std::string());
+    }
+
+    void Proceed(bool ok) {
+        (void) ok;
+        workerDone();
+        finish_pool_container_start(runtimeId_.c_str(), generation_, containerId_.c_str(), udsDir_.c_str(), result_);
+        delete this;
+    }
+
+private:
+    std::string runtimeId_;
+    std::string udsDir_;
+    uint32 generation_;
+};
+
 class StopContainerCall final : public Call {
 public:
     explicit StopContainerCall(PLCoordinator::AsyncService* service, grpc::ServerCompletionQueue* cq)
@@ -80,9 +215,9 @@ public:
             } else {
                 response_.set_status(destroy_container((pid_t)request_.qe_pid(), request_.session_id(), request_.command_count()));
                 responder_.Finish(response_, grpc::Status::OK, this);
-                plc_elog(DEBUG1, "StopContainer request successfully. request:%s response:%s",
-                        request_.DebugString().c_str(),
-                        response_.DebugString().c_str());
+                plc_elog_lazy(DEBUG1, "StopContainer request successfully. request:%s response:%s",
+                        PLContainerProtoUtils::TracePayload(request_).c_str(),
+                        PLContainerProtoUtils::TracePayload(response_).c_str());
             }
             status_ = FINISH;
             break;
@@ -107,6 +242,97 @@ private:
     CallStatus status_;
 };
 
+/*
+ * Asks a released container to reset its state. The answer comes back on the
+ * server completion queue, so it is handled on the main thread as well.
+ */
+class ResetContainerCall final : public Call {
+public:
+    ResetContainerCall(const ReleaseContainerRequest &release, grpc::CompletionQueue* cq)
+        : release_(release) {
+        stub_ = PLContainer::NewStub(grpc::CreateChannel("unix://" + release_.container_address(), grpc::InsecureChannelCredentials()));
+        ctx_.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(RESET_STATE_TIMEOUT_SEC));
+        reader_ = stub_->AsyncResetState(&ctx_, request_, cq);
+        reader_->Finish(&response_, &status_, this);
+    }
+
+    void Proceed(bool ok) {
+        bool reset = ok && status_.ok() && !response_.has_exception();
+
+        if (!reset) {
+            plc_elog(LOG, "failed to reset container %s: %s", release_.container_id().c_str(),
+                     status_.ok() ? response_.exception().message().c_str() : status_.error_message().c_str());
+        }
+        finish_container_release(release_.runtime_id().c_str(), release_.ownername().c_str(), release_.generation(),
+                                 release_.container_id().c_str(), release_.container_address().c_str(), reset);
+        delete this;
+    }
+
+private:
+    ReleaseContainerRequest release_;
+    std::unique_ptr<PLContainer::Stub> stub_;
+    grpc::ClientContext ctx_;
+    ResetStateRequest request_;
+    ResetStateResponse response_;
+    grpc::Status status_;
+    std::unique_ptr<grpc::ClientAsyncResponseReader<ResetStateResponse>> reader_;
+};
+
+/*
+ * The QE is answered right away, the container it released is reset by a
+ * ResetContainerCall meanwhile.
+ */
+class ReleaseContainerCall final : public Call {
+public:
+    explicit ReleaseContainerCall(PLCoordinator::AsyncService* service, grpc::ServerCompletionQueue* cq)
+        : service_(service), cq_(cq), responder_(&ctx_), status_(REQUEST) {
+        service_->RequestReleaseContainer(&ctx_, &request_, &responder_, cq_, cq_, this);
+    }
+
+    void Proceed(bool ok) {
+        int ret;
+        switch (status_) {
+        case REQUEST:
+            new ReleaseContainerCall(service_, cq_);
+            if (!ok) {
+                responder_.FinishWithError(grpc::Status::CANCELLED, this);
+                plc_elog(WARNING, "ReleaseContainer Request is not ok. Finishing.");
+            } else {
+                ret = prepare_container_release(request_.runtime_id().c_str(), request_.generation(), (pid_t)request_.qe_pid(),
+                                                request_.session_id(), request_.command_count(), request_.container_id().c_str());
+                if (ret == 1) {
+                    new ResetContainerCall(request_, cq_);
+                    ret = 0;
+                }
+                response_.set_status(ret);
+                responder_.Finish(response_, grpc::Status::OK, this);
+                plc_elog_lazy(DEBUG1, "ReleaseContainer request successfully. request:%s response:%s",
+                        PLContainerProtoUtils::TracePayload(request_).c_str(),
+                        PLContainerProtoUtils::TracePayload(response_).c_str());
+            }
+            status_ = FINISH;
+            break;
+
+        case FINISH:
+            if (!ok) {
+                plc_elog(ERROR, "ReleaseContainer RPC finished unexpectedly");
+            }
+            delete this;
+            break;
+        }
+    }
+
+private:
+    PLCoordinator::AsyncService* service_;
+    grpc::ServerCompletionQueue* cq_;
+    grpc::ServerContext ctx_;
+    grpc::ServerAsyncResponseWriter<ReleaseContainerResponse> responder_;
+    ReleaseContainerRequest request_;
+    ReleaseContainerResponse response_;
+    enum CallStatus { REQUEST, FINISH };
+    CallStatus status_;
+};
+
 AsyncServer::~AsyncServer() {
     server_->Shutdown();
     cq_->Shutdown();
@@ -118,39 +344,93 @@ void AsyncServer::Init(const std::string &uds) {
     builder.RegisterService(&service_);
     cq_ = builder.AddCompletionQueue();
     server_ = builder.BuildAndStart();
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        plc_elog(ERROR, "failed to create event fd for the server: %s", strerror(errno));
+    }
     plc_elog(LOG, "Asynchronous server listening on address %s.", uds.c_str());
 }
 
+AsyncServer::AsyncServer() {
+    this->creating_ = 0;
+    this->event_fd_ = -1;
+}
+
+/*
+ * Container starts of different sessions run concurrently, at most
+ * plcontainer.max_creating_docker_num at a time, the others wait in order.
+ */
+void AsyncServer::ScheduleContainerStart(ContainerStart *call) {
+    if (this->creating_ < ::plc_max_docker_creating_num) {
+        this->creating_++;
+        call->StartWorker();
+    } else {
+        plc_elog_lazy(DEBUG1, "%d containers are being created, start queued", this->creating_);
+        this->waiting_.push_back(call);
+    }
+}
+
+void AsyncServer::ContainerStartDone() {
+    if (!this->waiting_.empty()) {
+        ContainerStart *call = this->waiting_.front();
+        this->waiting_.pop_front();
+        call->StartWorker();
+    } else {
+        this->creating_--;
+    }
+}
+
+ContainerStart *AsyncServer::NewPoolContainerStart(runtimeConfEntry *conf, const char *uds_dir, int dbid) {
+    return new PoolContainerStart(this, cq_.get(), conf, uds_dir, dbid);
+}
+
 void AsyncServer::Start() {
-    new StartContainerCall(&service_, cq_.get());
+    new StartContainerCall(this, &service_, cq_.get());
     new StopContainerCall(&service_, cq_.get());
+    new ReleaseContainerCall(&service_, cq_.get());
+    poller_ = std::thread(&AsyncServer::pollCompletionQueue, this);
     plc_elog(LOG, "Asynchronous server started.");
 }
 
-void AsyncServer::ProcessRequest(int timeout_seconds) {
+/*
+ * Blocks on the completion queue in its own thread and wakes the main loop
+ * through event_fd_ for every event, the calls themselves only proceed on the
+ * main thread in ProcessRequest(). No elog here.
+ */
+void AsyncServer::pollCompletionQueue() {
     void* tag;
     bool ok;
-    CompletionQueue::NextStatus status; 
-    std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::seconds(timeout_seconds);
-    for (;;) {
-        status = cq_->AsyncNext(&tag, &ok, deadline);
-        if (status == CompletionQueue::GOT_EVENT) {
-            plc_elog(LOG, "aserver got request event to handle, ok:%d", ok);
-            static_cast<Call*>(tag)->Proceed(ok);
-            continue;
-        } else if (status == CompletionQueue::TIMEOUT) {
-            plc_elog(DEBUG3, "aserver got timeout event, return to caller, ok:%d", ok);
-            break;
-        } else if (status == CompletionQueue::SHUTDOWN) {
-            plc_elog(LOG, "server got shutdown event, return to caller, ok:%d", ok);
-            break;
-        } else {
-            plc_elog(ERROR, "server got unknown status:%d", status);
+    uint64_t one = 1;
+
+    while (cq_->Next(&tag, &ok)) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.emplace_back(tag, ok);
+        }
+        if (write(event_fd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
             break;
         }
     }
 }
 
+void AsyncServer::ProcessRequest() {
+    std::deque<std::pair<void *, bool>> events;
+    uint64_t count;
+
+    // reset the event fd before taking the events, so none is missed
+    if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        plc_elog(ERROR, "failed to read server event fd: %s", strerror(errno));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events.swap(events_);
+    }
+    for (auto &event : events) {
+        plc_elog_lazy(DEBUG1, "aserver got request event to handle, ok:%d", event.second);
+        static_cast<Call*>(event.first)->Proceed(event.second);
+    }
+}
+
 PLCoordinatorServer *start_server(const char *address) {
     PLCoordinatorServer *server = (PLCoordinatorServer *)palloc(sizeof(PLCoordinatorServer));
     server->address = pstrdup(address);
@@ -161,9 +441,17 @@ PLCoordinatorServer *start_server(const char *address) {
     return server;
 }
 
-int process_request(PLCoordinatorServer *server, int timeout_seconds) {
+int process_request(PLCoordinatorServer *server) {
     AsyncServer *s = (AsyncServer *)server->server;
-    s->ProcessRequest(timeout_seconds);
-    plc_elog(DEBUG3, "server %p timeout in %d seconds", server, timeout_seconds);
+    s->ProcessRequest();
     return 0;
 }
+
+int get_server_event_fd(PLCoordinatorServer *server) {
+    return ((AsyncServer *)server->server)->EventFd();
+}
+
+void schedule_pool_container_start(PLCoordinatorServer *server, runtimeConfEntry *conf, const char *uds_dir, int dbid) {
+    AsyncServer *s = (AsyncServer *)server->server;
+    s->ScheduleContainerStart(s->NewPoolContainerStart(conf, uds_dir, dbid));
+}
@@ -4,7 +4,6 @@
 PLContainerClient *PLContainerClient::client = NULL; 
 
 PLContainerClient::PLContainerClient() {
-    this->stub_ = NULL;
     this->ctx = NULL;
 }
 
@@ -15,19 +14,52 @@ PLContainerClient *PLContainerClient::GetPLContainerClient() {
     return client;
 }
 
+/*
+ * Channels are kept per service address for the whole session, so a query
+ * switching between runtimes reuses the connection of each container.
+ */
 void PLContainerClient::Init(const plcContext *ctx) {
+    std::string address(ctx->service_address);
+    std::map<std::string, std::shared_ptr<PLContainerChannel>>::iterator it;
+
     this->ctx = ctx;
 
-    if (ctx->is_new_ctx) {
-        std::string uds(ctx->service_address);
-        uds = "unix://" + uds;
-        this->stub_ = PLContainer::NewStub(grpc::CreateChannel(uds, grpc::InsecureChannelCredentials()));
+    it = this->channels_.find(address);
+    if (it == this->channels_.end()) {
+        std::shared_ptr<PLContainerChannel> channel = std::make_shared<PLContainerChannel>();
+        channel->stub = PLContainer::NewStub(grpc::CreateChannel("unix://" + address, grpc::InsecureChannelCredentials()));
+        channel->streaming = true;
+        channel->registration = true;
+        this->channels_[address] = channel;
+        this->channel_ = channel;
+        plc_elog_lazy(DEBUG1, "new channel to %s, %lu channels cached", address.c_str(), (unsigned long)this->channels_.size());
+    } else {
+        this->channel_ = it->second;
+    }
+}
+
+void PLContainerClient::ReleaseChannel(const char *address) {
+    std::map<std::string, std::shared_ptr<PLContainerChannel>>::iterator it = this->channels_.find(address);
+
+    if (it == this->channels_.end()) {
+        return;
+    }
+    if (this->channel_ == it->second) {
+        this->channel_.reset();
+        this->ctx = NULL;
     }
+    this->channels_.erase(it);
 }
 
-void PLContainerClient::FunctionCall(const CallRequest &request, CallResponse &response) {
+std::unique_ptr<grpc::ClientAsyncReader<CallResponse>> PLContainerClient::AsyncFunctionCallStream(PLContainerChannel *channel, grpc::ClientContext *context, const CallRequest &request, grpc::CompletionQueue *cq, void *tag) {
+    plc_elog_lazy(DEBUG1, "function call stream request:%s", PLContainerProtoUtils::TracePayload(request).c_str());
+    return channel->stub->AsyncFunctionCallStream(context, request, cq, tag);
+}
+
+void PLContainerClient::FunctionCall(PLContainerChannel *channel, CallRequest &request, CallResponse &response) {
     std::chrono::system_clock::time_point deadline;
     grpc::Status status; 
+    bool retry = true;
     while (true) {
         CHECK_FOR_INTERRUPTS();
 
@@ -39,12 +71,14 @@ void PLContainerClient::FunctionCall(const CallRequest &request, CallResponse &r
             context.set_deadline(deadline);
         }
 
-        plc_elog(DEBUG1, "function call request:%s", request.DebugString().c_str());
-        status = stub_->FunctionCall(&context, request, &response);
-        plc_elog(DEBUG1, "function call response:%s", response.DebugString().c_str());
+        plc_elog_lazy(DEBUG1, "function call request:%s", PLContainerProtoUtils::TracePayload(request).c_str());
+        status = channel->stub->FunctionCall(&context, request, &response);
+        plc_elog_lazy(DEBUG1, "function call response:%s", PLContainerProtoUtils::TracePayload(response).c_str());
         if (!status.ok()) {
             if (status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
                 plc_elog(LOG, "plcontainer functioncall timeout");
+            } else if (this->CheckFunctionHandle(channel, status, request, retry)) {
+                retry = false;
             } else {
                 plc_elog(ERROR, "plcontainer function call RPC failed., error:%s", status.error_message().c_str());
             }
@@ -58,7 +92,185 @@ void PLContainerClient::FunctionCall(const CallRequest &request, CallResponse &r
             break;
         }
     }
-    plc_elog(DEBUG1, "PLContainerClient function call finished with status %d", status.error_code());
+    plc_elog_lazy(DEBUG1, "PLContainerClient function call finished with status %d", status.error_code());
+}
+
+/*
+ * Identify the function in request by the handle the runtime returned when
+ * this version of the function was registered on the channel, registering it
+ * first if needed. Only runtimes without RegisterFunction get the source text
+ * with every call.
+ */
+void PLContainerClient::PrepareFunction(const plcProcInfo *proc, CallRequest &request) {
+    std::map<Oid, PLContainerFunction>::iterator it;
+
+    if (this->channel_->registration) {
+        it = this->channel_->functions.find(proc->funcOid);
+        if (it != this->channel_->functions.end() && it->second.xmin == proc->fn_xmin && !proc->hasChanged) {
+            request.set_functionhandle(it->second.handle);
+            return;
+        }
+
+        // kept to register the function again should the runtime lose it
+        PLContainerFunction &function = this->channel_->functions[proc->funcOid];
+        function.xmin = InvalidTransactionId;
+        function.registration.set_runtimetype(request.runtimetype());
+        function.registration.set_objectid(proc->funcOid);
+        function.registration.set_xmin(proc->fn_xmin);
+        function.registration.mutable_proc()->set_src(proc->src);
+        function.registration.mutable_proc()->set_name(proc->name);
+        function.registration.set_serverenc(request.serverenc());
+        if (this->registerFunction(this->channel_.get(), function.registration, &function.handle)) {
+            function.xmin = proc->fn_xmin;
+            request.set_functionhandle(function.handle);
+            return;
+        }
+        this->channel_->functions.erase(proc->funcOid);
+    }
+
+    request.mutable_proc()->set_src(proc->src);
+    request.mutable_proc()->set_name(proc->name);
+}
+
+bool PLContainerClient::registerFunction(PLContainerChannel *channel, const RegisterFunctionRequest &registerRequest, uint64_t *handle) {
+    RegisterFunctionResponse    registerResponse;
+    grpc::ClientContext context;
+    grpc::Status status;
+
+    CHECK_FOR_INTERRUPTS();
+
+    context.set_wait_for_ready(true);
+    if (::plc_client_timeout != -1) {
+        context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(::plc_client_timeout));
+    }
+
+    plc_elog_lazy(DEBUG1, "register function request:%s", PLContainerProtoUtils::TracePayload(registerRequest).c_str());
+    status = channel->stub->RegisterFunction(&context, registerRequest, &registerResponse);
+    plc_elog_lazy(DEBUG1, "register function response:%s", PLContainerProtoUtils::TracePayload(registerResponse).c_str());
+    if (!status.ok()) {
+        if (status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+            plc_elog_lazy(DEBUG1, "plcontainer runtime does not support function registration, sending the source with every call");
+            channel->registration = false;
+            return false;
+        }
+        plc_elog(ERROR, "plcontainer register function RPC failed., error:%s", status.error_message().c_str());
+    } else if (registerResponse.has_exception()) {
+        const Error &error = registerResponse.exception();
+        plc_elog(ERROR, "plcontainer register function failed. error:%s stacktrace:%s", error.message().c_str(), error.stacktrace().c_str());
+    }
+
+    *handle = registerResponse.handle();
+    return true;
+}
+
+/*
+ * A runtime that lost a registered function, e.g. after a restart at the same
+ * address, rejects its handle. With retry the function is registered again,
+ * or its source put into request, and true is returned so that request is
+ * sent once more. Otherwise the registration is forgotten and an error is
+ * raised. Returns false for any other failure.
+ */
+bool PLContainerClient::CheckFunctionHandle(PLContainerChannel *channel, const grpc::Status &status, CallRequest &request, bool retry) {
+    std::map<Oid, PLContainerFunction>::iterator it;
+
+    if (status.error_code() != grpc::StatusCode::NOT_FOUND || request.functionhandle() == 0) {
+        return false;
+    }
+
+    it = channel->functions.find(request.objectid());
+    if (!retry || it == channel->functions.end()) {
+        channel->functions.erase(request.objectid());
+        plc_elog(ERROR, "plcontainer runtime does not know function %u any more, error:%s",
+                        request.objectid(), status.error_message().c_str());
+    }
+
+    plc_elog(LOG, "plcontainer runtime does not know function %u any more, registering it again", request.objectid());
+    it->second.xmin = InvalidTransactionId;
+    if (this->registerFunction(channel, it->second.registration, &it->second.handle)) {
+        it->second.xmin = it->second.registration.xmin();
+        request.set_functionhandle(it->second.handle);
+    } else {
+        *request.mutable_proc() = it->second.registration.proc();
+        request.clear_functionhandle();
+        channel->functions.erase(it);
+    }
+    return true;
+}
+
+void PLContainerClient::BatchFunctionCall(PLContainerChannel *channel, BatchCallRequest &request, BatchCallResponse &response, bool retry) {
+    std::chrono::system_clock::time_point deadline;
+    grpc::Status status; 
+    while (true) {
+        CHECK_FOR_INTERRUPTS();
+
+        grpc::ClientContext context;
+        context.set_wait_for_ready(true);
+
+        if (::plc_client_timeout != -1) {
+            deadline = std::chrono::system_clock::now() + std::chrono::seconds(::plc_client_timeout);
+            context.set_deadline(deadline);
+        }
+
+        plc_elog_lazy(DEBUG1, "batch function call request:%s", PLContainerProtoUtils::TracePayload(request).c_str());
+        status = channel->stub->BatchFunctionCall(&context, request, &response);
+        if (this->CheckBatchFunctionCall(channel, status, request, response, &retry)) {
+            break;
+        }
+    }
+    plc_elog_lazy(DEBUG1, "PLContainerClient batch function call finished with status %d", status.error_code());
+}
+
+void PLContainerClient::AsyncBatchFunctionCall(grpc::CompletionQueue *cq, PLContainerPendingCall *call) {
+    call->context.set_wait_for_ready(true);
+    if (::plc_client_timeout != -1) {
+        call->context.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(::plc_client_timeout));
+    }
+
+    plc_elog_lazy(DEBUG1, "async batch function call request:%s", PLContainerProtoUtils::TracePayload(call->request).c_str());
+    call->channel = this->channel_;
+    call->reader = call->channel->stub->AsyncBatchFunctionCall(&call->context, call->request, cq);
+    call->reader->Finish(&call->response, &call->status, (void *)call);
+}
+
+/*
+ * Raise the error of a finished batch call, if any. Returns false when the
+ * runtime lost the function and *retry allowed to register it again, so the
+ * call has to be sent again; none of its rows ran then. A call that timed out
+ * is not sent again, as its rows may have run in the container meanwhile.
+ */
+bool PLContainerClient::CheckBatchFunctionCall(PLContainerChannel *channel, const grpc::Status &status, BatchCallRequest &request, BatchCallResponse &response, bool *retry) {
+    plc_elog_lazy(DEBUG1, "batch function call response:%s", PLContainerProtoUtils::TracePayload(response).c_str());
+    if (!status.ok()) {
+        if (status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
+            plc_elog(ERROR, "plcontainer batch function call of %d rows timed out, some of them may have run",
+                            PLContainerBatch::Rows(request));
+        }
+        if (this->CheckFunctionHandle(channel, status, *request.mutable_call(), *retry)) {
+            *retry = false;
+            return false;
+        }
+        if (status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+            plc_elog(ERROR, "plcontainer runtime does not support batched function call, "
+                            "set plcontainer.batch_size to 1 to disable it");
+        } else {
+            plc_elog(ERROR, "plcontainer batch function call RPC failed., error:%s", status.error_message().c_str());
+        }
+    } else if (response.has_exception()) {
+        Error *error = response.mutable_exception();
+        plc_elog(ERROR, "plcontainer batch function call failed. error:%s stacktrace:%s", error->message().c_str(), error->stacktrace().c_str());
+    } else if (response.results_size() != PLContainerBatch::Rows(request)) {
+        plc_elog(ERROR, "plcontainer batch function call returned %d results for %d rows",
+                        response.results_size(), PLContainerBatch::Rows(request));
+    } else {
+        for (int i=0;i<response.results_size();i++) {
+            if (response.results(i).has_exception()) {
+                const Error &error = response.results(i).exception();
+                plc_elog(ERROR, "plcontainer function call failed at batched row %d. error:%s stacktrace:%s",
+                                i, error.message().c_str(), error.stacktrace().c_str());
+            }
+        }
+    }
+    return true;
 }
 
 void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, const plcProcInfo *proc, int argIdx, ScalarData &arg) {
@@ -66,7 +278,7 @@ void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, c
                         proc->argnames[argIdx],
                         fcinfo->argnull[argIdx],
                         &proc->args[argIdx],
-                        fcinfo->argnull[argIdx] ? NULL : proc->args[argIdx].outfunc(fcinfo->arg[argIdx], &proc->args[argIdx]));
+                        fcinfo->argnull[argIdx] ? NULL : PLContainerProtoUtils::DatumOutput(fcinfo->arg[argIdx], &proc->args[argIdx]));
 }
 
 void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, const plcProcInfo *proc, int argIdx, ArrayData &arg) {
@@ -77,14 +289,10 @@ void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, c
     }
      
     if (!fcinfo->argnull[argIdx]) {
-        char *argvalue = proc->args[argIdx].outfunc(fcinfo->arg[argIdx], &proc->args[argIdx]);
-        int size = *(int *)argvalue;
-        if (!arg.ParseFromArray(argvalue+sizeof(int), size)) {
-            plc_elog(ERROR, "array outfunc parse failed");
-        }
+        PLContainerProtoUtils::DatumAsProtoData(fcinfo->arg[argIdx], &proc->args[argIdx], arg);
     }
 
-    plc_elog(DEBUG1, "array data parse result:%s", arg.DebugString().c_str());
+    plc_elog_lazy(DEBUG1, "array data parse result:%s", PLContainerProtoUtils::TracePayload(arg).c_str());
 }
 
 void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, const plcProcInfo *proc, int argIdx, CompositeData &arg) {
@@ -95,14 +303,10 @@ void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, c
     }
      
     if (!fcinfo->argnull[argIdx]) {
-        char *argvalue = proc->args[argIdx].outfunc(fcinfo->arg[argIdx], &proc->args[argIdx]);
-        int size = *(int *)argvalue;
-        if (!arg.ParseFromArray(argvalue+sizeof(int), size)) {
-            plc_elog(ERROR, "composited outfunc parse failed");
-        }
+        PLContainerProtoUtils::DatumAsProtoData(fcinfo->arg[argIdx], &proc->args[argIdx], arg);
     }
 
-    plc_elog(DEBUG1, "composite data parse result:%s", arg.DebugString().c_str());
+    plc_elog_lazy(DEBUG1, "composite data parse result:%s", PLContainerProtoUtils::TracePayload(arg).c_str());
 }
 
 void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, const plcProcInfo *proc, int argIdx, SetOfData &arg) {
@@ -113,19 +317,15 @@ void PLContainerClient::initCallRequestArgument(const FunctionCallInfo fcinfo, c
     }
 
     if (!fcinfo->argnull[argIdx]) {
-        char *argvalue = proc->args[argIdx].outfunc(fcinfo->arg[argIdx], &proc->args[argIdx]);
-        int size = *(int *)argvalue;
-        if (!arg.ParseFromArray(argvalue+sizeof(int), size)) {
-            plc_elog(ERROR, "setof outfunc parse failed");
-        }
+        PLContainerProtoUtils::DatumAsProtoData(fcinfo->arg[argIdx], &proc->args[argIdx], arg);
     }
 
-    plc_elog(DEBUG1, "setof data parse result:%s", arg.DebugString().c_str());
+    plc_elog_lazy(DEBUG1, "setof data parse result:%s", PLContainerProtoUtils::TracePayload(arg).c_str());
 }
 
 void PLContainerClient::InitCallRequest(const FunctionCallInfo fcinfo, PlcRuntimeType type, CallRequest &request) {
     const InlineCodeBlock * const icb = (InlineCodeBlock *)PG_GETARG_POINTER(0);
-    plc_elog(DEBUG1, "plcontainer inline function :%s, source_text:%s",
+    plc_elog_lazy(DEBUG1, "plcontainer inline function :%s, source_text:%s",
             PLContainerClient::functionCallInfoToStr(fcinfo).c_str(),
             icb->source_text);
 
@@ -142,14 +342,17 @@ void PLContainerClient::InitCallRequest(const FunctionCallInfo fcinfo, PlcRuntim
 }
 
 void PLContainerClient::InitCallRequest(const FunctionCallInfo fcinfo, const plcProcInfo *proc, PlcRuntimeType type, CallRequest &request) {
-    plc_elog(DEBUG1, "fcinfo is :%s", PLContainerClient::functionCallInfoToStr(fcinfo).c_str());
-    plc_elog(DEBUG1, "proc is %s", PLContainerClient::procInfoToStr(proc).c_str());
+    PLContainerClient::InitCallRequestHeader(fcinfo, proc, type, request);
+    PLContainerClient::InitCallRequestArguments(fcinfo, proc, *request.mutable_args());
+}
+
+void PLContainerClient::InitCallRequestHeader(const FunctionCallInfo fcinfo, const plcProcInfo *proc, PlcRuntimeType type, CallRequest &request) {
+    plc_elog_lazy(DEBUG1, "fcinfo is :%s", PLContainerClient::functionCallInfoToStr(fcinfo).c_str());
+    plc_elog_lazy(DEBUG1, "proc is %s", PLContainerClient::procInfoToStr(proc).c_str());
 
     request.set_runtimetype(type);
     request.set_objectid(proc->funcOid);
     request.set_haschanged(proc->hasChanged);
-    request.mutable_proc()->set_src(proc->src);
-    request.mutable_proc()->set_name(proc->name);
     request.set_loglevel(log_min_messages);
     PLContainerClient::setFunctionReturnType(request.mutable_rettype(), &proc->result, fcinfo->flinfo->fn_retset);
     if (GetDatabaseEncoding() == PG_SQL_ASCII) {
@@ -157,9 +360,11 @@ void PLContainerClient::InitCallRequest(const FunctionCallInfo fcinfo, const plc
     } else {
         request.set_serverenc(GetDatabaseEncodingName());            
     }
+}
 
+void PLContainerClient::InitCallRequestArguments(const FunctionCallInfo fcinfo, const plcProcInfo *proc, google::protobuf::RepeatedPtrField<PlcValue> &args) {
     for (int i=0;i<proc->nargs;i++) {
-        PlcValue *arg = request.add_args();
+        PlcValue *arg = args.Add();
         arg->set_type(PLContainerProtoUtils::GetDataType(&proc->args[i]));
         if (proc->argnames[i]) {
             arg->set_name(proc->argnames[i]);
@@ -235,17 +440,14 @@ Datum PLContainerClient::getCallResponseAsDatum(const FunctionCallInfo fcinfo, p
         *(int32_t *)buffer = response.intvalue();
         break;
     case PLC_DATA_INT8:
-        buffer = (char *)palloc(8); 
-        *(int64_t *)buffer = response.realvalue();
-        break;
+    case PLC_DATA_FLOAT8:
+        // bigint and numeric may come exactly, see plcontainer.lossless_numeric
+        fcinfo->isnull = false;
+        return PLContainerProtoUtils::DatumFromProtoData(response, &proc->result);
     case PLC_DATA_FLOAT4:
         buffer = (char *)palloc(4);
         *(float *)buffer = response.realvalue();
         break;
-    case PLC_DATA_FLOAT8:
-        buffer = (char *)palloc(8);
-        *(double *)buffer = response.realvalue();
-        break;
     case PLC_DATA_TEXT:
         buffer = (char *)palloc(response.stringvalue().size()+1);
         strncpy(buffer, response.stringvalue().c_str(), response.stringvalue().size()+1);
@@ -268,7 +470,7 @@ Datum PLContainerClient::getCallResponseAsDatum(const FunctionCallInfo fcinfo, p
 }
 
 Datum PLContainerClient::getCallResponseAsDatum(const FunctionCallInfo fcinfo, plcProcInfo *proc, const ArrayData &response) {
-    if (response.values_size() == 0) {
+    if (response.values_size() == 0 && !response.has_packedvalues()) {
         return (Datum)0;
     } else {
         fcinfo->isnull = false;
@@ -286,8 +488,13 @@ Datum PLContainerClient::getCallResponseAsDatum(const FunctionCallInfo fcinfo, p
 }
 
 Datum PLContainerClient::getCallResponseAsDatum(const FunctionCallInfo fcinfo, plcProcInfo *proc, const SetOfData &response, int row_index) {
-    if (response.rowvalues_size() == 0) {
+    if (PLContainerProtoUtils::SetOfRows(response) == 0) {
         return (Datum)0;
+    } else if (response.has_columnvalues() && proc->result.type != PLC_DATA_ARRAY) {
+        bool isnull;
+        Datum result = PLContainerProtoUtils::DatumFromProtoColumns(response.columnvalues(), row_index, &proc->result, &isnull);
+        fcinfo->isnull = isnull;
+        return result;
     } else {
         fcinfo->isnull = false;
         if (proc->result.type == PLC_DATA_ARRAY) {
@@ -440,6 +647,524 @@ std::string PLContainerClient::typeInfoToStr(const plcTypeInfo *type) {
     return std::string(result);
 }
 
+PLContainerResultStream::PLContainerResultStream(PLContainerClient *client) {
+    this->client_ = client;
+    this->channel_ = client->CurrentChannel();
+    this->chunks_ = 0;
+    this->finished_ = false;
+}
+
+PLContainerResultStream::~PLContainerResultStream() {
+    grpc::Status status;
+    void *tag;
+    bool ok;
+
+    if (this->reader_) {
+        // the executor stopped before the last row, drop the rest of the stream
+        this->context_.TryCancel();
+        this->reader_->Finish(&status, (void *)this);
+        this->cq_.Next(&tag, &ok);
+    }
+    this->cq_.Shutdown();
+    while (this->cq_.Next(&tag, &ok)) {
+    }
+}
+
+void PLContainerResultStream::Start(const CallRequest &request) {
+    /*
+     * No deadline on the context, a stream lives as long as the executor
+     * keeps reading from it. wait() bounds each chunk by plc_client_timeout.
+     */
+    this->context_.set_wait_for_ready(true);
+    this->request_ = request;
+
+    if (!this->channel_->streaming) {
+        this->functionCall();
+        return;
+    }
+    this->reader_ = this->client_->AsyncFunctionCallStream(this->channel_.get(), &this->context_, this->request_, &this->cq_, (void *)this);
+    // a failed start fails the first read too, which gets the status
+    this->wait("start");
+}
+
+/*
+ * Wait for the only operation in flight on cq_ and return its ok flag. The
+ * query can be cancelled meanwhile, and the wait ends with an error after
+ * plc_client_timeout seconds. Either way the call is cancelled and the
+ * operation has returned its tag before the error is raised.
+ */
+bool PLContainerResultStream::wait(const char *operation) {
+    std::chrono::system_clock::time_point deadline;
+    void *tag;
+    bool ok;
+
+    if (::plc_client_timeout != -1) {
+        deadline = std::chrono::system_clock::now() + std::chrono::seconds(::plc_client_timeout);
+    }
+    while (true) {
+        grpc::CompletionQueue::NextStatus status = this->cq_.AsyncNext(&tag, &ok,
+                        std::chrono::system_clock::now() + std::chrono::seconds(1));
+        if (status == grpc::CompletionQueue::GOT_EVENT) {
+            return ok;
+        } else if (status == grpc::CompletionQueue::SHUTDOWN) {
+            plc_elog(ERROR, "plcontainer function call stream queue is shut down");
+        }
+
+        bool timedout = ::plc_client_timeout != -1 && std::chrono::system_clock::now() >= deadline;
+        if (QueryCancelPending || ProcDiePending || timedout) {
+            this->context_.TryCancel();
+            this->cq_.Next(&tag, &ok);
+            this->reader_.reset();
+            this->finished_ = true;
+            CHECK_FOR_INTERRUPTS();
+            plc_elog(ERROR, "plcontainer function call stream %s at %s of chunk %d",
+                     timedout ? "timed out" : "cancelled", operation, this->chunks_ + 1);
+        }
+    }
+}
+
+/*
+ * Return the chunk holding the next row, reading further chunks as the
+ * current one is used up, or NULL once all rows have been returned.
+ */
+CallResponse *PLContainerResultStream::Current() {
+    while (this->chunks_ == 0 || this->chunk_.result_rows() >= PLContainerResultStream::rows(this->chunk_)) {
+        CHECK_FOR_INTERRUPTS();
+        if (this->finished_ || !this->readChunk()) {
+            return NULL;
+        }
+    }
+    return &this->chunk_;
+}
+
+bool PLContainerResultStream::readChunk() {
+    grpc::Status status;
+
+    this->reader_->Read(&this->chunk_, (void *)this);
+    if (this->wait("read")) {
+        this->chunks_++;
+        this->chunk_.set_result_rows(0);
+        plc_elog_lazy(DEBUG1, "function call stream chunk %d with %d rows", this->chunks_, PLContainerResultStream::rows(this->chunk_));
+        if (this->chunk_.has_exception()) {
+            const Error &error = this->chunk_.exception();
+            plc_elog(ERROR, "plcontainer function call failed. error:%s stacktrace:%s", error.message().c_str(), error.stacktrace().c_str());
+        }
+        return true;
+    }
+
+    this->reader_->Finish(&status, (void *)this);
+    this->wait("finish");
+    this->reader_.reset();
+    this->finished_ = true;
+    if (status.ok()) {
+        return false;
+    } else if (status.error_code() == grpc::StatusCode::UNIMPLEMENTED && this->chunks_ == 0) {
+        plc_elog_lazy(DEBUG1, "plcontainer runtime does not support function call stream, fall back to function call");
+        this->channel_->streaming = false;
+        this->functionCall();
+        return true;
+    } else if (this->chunks_ == 0 && this->client_->CheckFunctionHandle(this->channel_.get(), status, this->request_, true)) {
+        // registered again, the whole set comes in a single call then
+        this->functionCall();
+        return true;
+    } else {
+        this->client_->CheckFunctionHandle(this->channel_.get(), status, this->request_, false);
+        plc_elog(ERROR, "plcontainer function call stream RPC failed., error:%s", status.error_message().c_str());
+    }
+    return false;
+}
+
+// the whole set in a single response, served as the only chunk
+void PLContainerResultStream::functionCall() {
+    this->finished_ = true;
+    this->client_->FunctionCall(this->channel_.get(), this->request_, this->chunk_);
+    this->chunks_ = 1;
+    this->chunk_.set_result_rows(0);
+}
+
+int PLContainerResultStream::rows(const CallResponse &chunk) {
+    if (chunk.results_size() == 0) {
+        return 0;
+    }
+    return PLContainerProtoUtils::SetOfRows(chunk.results(0).setofvalue());
+}
+
+PLContainerBatch *PLContainerBatch::batch = NULL;
+
+PLContainerBatch::PLContainerBatch() {
+    this->type_ = R;
+    this->reset();
+}
+
+PLContainerBatch *PLContainerBatch::GetPLContainerBatch() {
+    if (batch == NULL) {
+        batch = new PLContainerBatch;
+    }
+    return batch;
+}
+
+/*
+ * Only calls whose result the executor never looks at can be deferred, i.e.
+ * non-SRF functions returning void. Anything else needs its result at once.
+ */
+bool PLContainerBatch::IsBatchable(const FunctionCallInfo fcinfo, const plcProcInfo *proc) {
+    return ::plc_batch_size > 1
+        && !fcinfo->flinfo->fn_retset
+        && proc->result.type == PLC_DATA_VOID;
+}
+
+void PLContainerBatch::Append(const FunctionCallInfo fcinfo, const plcProcInfo *proc, PlcRuntimeType type, plcContext *ctx) {
+    SubTransactionId subid = GetCurrentSubTransactionId();
+
+    // rows of one batch share the function, the runtime, the container and the subtransaction
+    if (this->IsPending() && (this->funcOid_ != proc->funcOid || this->type_ != type || this->ctx_ != ctx ||
+                              this->subid_ != subid || proc->hasChanged)) {
+        this->Flush();
+    }
+
+    if (!this->IsPending()) {
+        PLContainerClient *client = PLContainerClient::GetPLContainerClient();
+        client->Init(ctx);
+        PLContainerClient::InitCallRequestHeader(fcinfo, proc, type, *this->request_.mutable_call());
+        client->PrepareFunction(proc, *this->request_.mutable_call());
+        this->type_ = type;
+        this->funcOid_ = proc->funcOid;
+        this->ctx_ = ctx;
+        this->columnar_ = PLContainerBatch::isColumnar(proc);
+        this->readonly_ = proc->fn_readonly;
+        this->subid_ = subid;
+        if (this->columnar_) {
+            ColumnarData *columns = this->request_.mutable_columns();
+            for (int i=0;i<proc->nargs;i++) {
+                PLContainerProtoUtils::InitProtoColumn(*columns->add_columns(), proc->argnames[i], &proc->args[i]);
+            }
+        }
+    }
+
+    // arguments are serialized right away, so nothing points into the executor's memory
+    if (this->columnar_) {
+        ColumnarData *columns = this->request_.mutable_columns();
+        int row = columns->rows();
+        for (int i=0;i<proc->nargs;i++) {
+            PLContainerProtoUtils::AppendDatumToColumn(*columns->mutable_columns(i), row,
+                                fcinfo->arg[i], fcinfo->argnull[i], &proc->args[i]);
+        }
+        columns->set_rows(row + 1);
+    } else {
+        PLContainerClient::InitCallRequestArguments(fcinfo, proc, *this->request_.add_rows()->mutable_args());
+    }
+
+    if (PLContainerBatch::Rows(this->request_) >= ::plc_batch_size) {
+        this->Flush();
+    }
+}
+
+int PLContainerBatch::Rows(const BatchCallRequest &request) {
+    if (request.has_columns()) {
+        return request.columns().rows();
+    }
+    return request.rows_size();
+}
+
+// scalar arguments are packed per column, one typed vector per argument
+bool PLContainerBatch::isColumnar(const plcProcInfo *proc) {
+    for (int i=0;i<proc->nargs;i++) {
+        if (!PLContainerProtoUtils::IsColumnType(&proc->args[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Send the collected rows without waiting for their results, as long as
+ * fewer than plcontainer.max_inflight_calls calls to the same container are
+ * outstanding; otherwise wait for the oldest ones first. The backend keeps
+ * executing and serializing further rows while the container works. A batch
+ * of a volatile function overlaps with no other, in flight calls may run in
+ * any order.
+ */
+void PLContainerBatch::Flush() {
+    PLContainerClient *client;
+    PLContainerPendingCall *call;
+    int rows = PLContainerBatch::Rows(this->request_);
+
+    if (!this->IsPending()) {
+        return;
+    }
+
+    while (this->inflight(this->ctx_) >= ::plc_max_inflight_calls ||
+           (!this->pending_.empty() && (!this->readonly_ || this->inflightVolatile()))) {
+        this->waitOldest();
+    }
+
+    client = PLContainerClient::GetPLContainerClient();
+    client->Init(this->ctx_);
+
+    call = new PLContainerPendingCall;
+    call->ctx = this->ctx_;
+    call->done = false;
+    call->readonly = this->readonly_;
+    call->subid = this->subid_;
+    call->request.Swap(&this->request_);
+    this->pending_.push_back(call);
+
+    plcContextBeginStage(this->ctx_, "R_batch_function_call", NULL);
+    client->AsyncBatchFunctionCall(&this->cq_, call);
+    plcContextEndStage(this->ctx_, "R_batch_function_call",
+            PLC_CONTEXT_STAGE_SUCCESS,
+            "[FUNCTION]:%u, [ROWS]:%d, [INFLIGHT]:%lu", this->funcOid_, rows, (unsigned long)this->pending_.size());
+    plcContextLogging(LOG, this->ctx_);
+
+    this->reset();
+}
+
+// send what is collected and wait until every row has run, in order
+void PLContainerBatch::Sync() {
+    this->Flush();
+    while (!this->pending_.empty()) {
+        this->waitOldest();
+    }
+}
+
+void PLContainerBatch::Discard() {
+    std::deque<PLContainerPendingCall *>::iterator it;
+
+    // calls in flight must hand their tags back before they are freed
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        (*it)->context.TryCancel();
+    }
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        void *tag;
+        bool ok;
+        while (!(*it)->done && this->cq_.Next(&tag, &ok)) {
+            ((PLContainerPendingCall *)tag)->done = true;
+        }
+    }
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        delete *it;
+    }
+    this->pending_.clear();
+    this->completed_.reset();
+
+    this->reset();
+}
+
+/*
+ * Drop the rows appended within subtransaction subid or the ones it started,
+ * as it is rolled back. Rows of the enclosing subtransactions still run.
+ */
+void PLContainerBatch::DiscardSubTransaction(SubTransactionId subid) {
+    std::deque<PLContainerPendingCall *> kept;
+    std::deque<PLContainerPendingCall *>::iterator it;
+
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        if ((*it)->subid >= subid) {
+            (*it)->context.TryCancel();
+        }
+    }
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        void *tag;
+        bool ok;
+        while ((*it)->subid >= subid && !(*it)->done && this->cq_.Next(&tag, &ok)) {
+            ((PLContainerPendingCall *)tag)->done = true;
+        }
+    }
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        if ((*it)->subid >= subid) {
+            delete *it;
+        } else {
+            kept.push_back(*it);
+        }
+    }
+    this->pending_.swap(kept);
+
+    if (this->IsPending() && this->subid_ >= subid) {
+        this->reset();
+    }
+}
+
+// nothing collected
+void PLContainerBatch::reset() {
+    this->request_.Clear();
+    this->ctx_ = NULL;
+    this->funcOid_ = InvalidOid;
+    this->columnar_ = false;
+    this->readonly_ = false;
+    this->subid_ = InvalidSubTransactionId;
+}
+
+int PLContainerBatch::inflight(const plcContext *ctx) const {
+    int count = 0;
+    std::deque<PLContainerPendingCall *>::const_iterator it;
+
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        if ((*it)->ctx == ctx) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool PLContainerBatch::inflightVolatile() const {
+    std::deque<PLContainerPendingCall *>::const_iterator it;
+
+    for (it = this->pending_.begin(); it != this->pending_.end(); it++) {
+        if (!(*it)->readonly) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Wait for the oldest call and check its results. Later calls finishing
+ * first are only marked done, results are always checked in sending order.
+ */
+void PLContainerBatch::waitOldest() {
+    PLContainerPendingCall *call = this->pending_.front();
+    PLContainerClient *client;
+    void *tag;
+    bool ok;
+    bool retry = true;
+
+    while (!call->done) {
+        grpc::CompletionQueue::NextStatus status = this->cq_.AsyncNext(&tag, &ok,
+                        std::chrono::system_clock::now() + std::chrono::seconds(1));
+        if (status == grpc::CompletionQueue::TIMEOUT) {
+            CHECK_FOR_INTERRUPTS();
+        } else if (status == grpc::CompletionQueue::SHUTDOWN) {
+            plc_elog(ERROR, "plcontainer batch function call queue is shut down");
+        } else {
+            ((PLContainerPendingCall *)tag)->done = true;
+        }
+    }
+
+    // owned by completed_ from here on, so an error below does not leak it
+    this->pending_.pop_front();
+    this->completed_.reset(call);
+
+    client = PLContainerClient::GetPLContainerClient();
+    if (!client->CheckBatchFunctionCall(call->channel.get(), call->status, call->request, call->response, &retry)) {
+        // registered again, send it again synchronously
+        client->BatchFunctionCall(call->channel.get(), call->request, call->response, retry);
+    }
+    this->completed_.reset();
+}
+
+#define PLC_ARENA_INITIAL_BLOCK_SIZE   (64 * 1024)
+
+google::protobuf::Arena *PLContainerArena::arena = NULL;
+MemoryContext PLContainerArena::context = NULL;
+int PLContainerArena::depth = 0;
+
+google::protobuf::Arena *PLContainerArena::Acquire() {
+    if (arena == NULL) {
+        google::protobuf::ArenaOptions options;
+
+        context = AllocSetContextCreate(TopMemoryContext,
+                                        "PL/Container protobuf arena",
+                                        ALLOCSET_DEFAULT_MINSIZE,
+                                        ALLOCSET_DEFAULT_INITSIZE,
+                                        ALLOCSET_DEFAULT_MAXSIZE);
+        options.initial_block = (char *) MemoryContextAlloc(TopMemoryContext, PLC_ARENA_INITIAL_BLOCK_SIZE);
+        options.initial_block_size = PLC_ARENA_INITIAL_BLOCK_SIZE;
+        options.block_alloc = PLContainerArena::blockAlloc;
+        options.block_dealloc = PLContainerArena::blockDealloc;
+        arena = new google::protobuf::Arena(options);
+    }
+    depth++;
+    return arena;
+}
+
+void PLContainerArena::Release() {
+    if (depth > 0 && --depth == 0) {
+        // keeps the initial block, the spilled ones go back to the context
+        arena->Reset();
+        MemoryContextReset(context);
+    }
+}
+
+void *PLContainerArena::blockAlloc(size_t size) {
+    return MemoryContextAllocHuge(context, size);
+}
+
+void PLContainerArena::blockDealloc(void *block, size_t size) {
+    (void) size;
+    pfree(block);
+}
+
+static void plcontainer_result_stream_shutdown(Datum arg) {
+    delete (PLContainerResultStream *) DatumGetPointer(arg);
+}
+
+static bool plcontainer_can_materialize(ReturnSetInfo *rsi, const plcProcInfo *proc) {
+    if (!rsi || !IsA(rsi, ReturnSetInfo) || (rsi->allowedModes & SFRM_Materialize) == 0) {
+        return false;
+    }
+    return proc->result.type == PLC_DATA_UDT || PLContainerProtoUtils::IsColumnType(&proc->result);
+}
+
+/*
+ * Decode all rows of the set straight into a tuplestore handed over to the
+ * executor, rather than returning to it once per row.
+ */
+static void plcontainer_materialize_result(FunctionCallInfo fcinfo, plcProcInfo *proc, PLContainerResultStream *stream) {
+    ReturnSetInfo *rsi = (ReturnSetInfo *) fcinfo->resultinfo;
+    MemoryContext oldcontext;
+    MemoryContext rowcontext;
+    TupleDesc tupdesc;
+    Tuplestorestate *tupstore;
+    CallResponse *chunk;
+    Datum *values;
+    bool *nulls;
+
+    oldcontext = MemoryContextSwitchTo(rsi->econtext->ecxt_per_query_memory);
+    if (proc->result.type == PLC_DATA_UDT) {
+        if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE) {
+            plc_elog(ERROR, "function returning composite type called in context that cannot accept it");
+        }
+        tupdesc = CreateTupleDescCopy(tupdesc);
+        if (tupdesc->natts != proc->result.nSubTypes) {
+            plc_elog(ERROR, "function result has %d columns, expect %d", proc->result.nSubTypes, tupdesc->natts);
+        }
+    } else {
+        tupdesc = CreateTemplateTupleDesc(1, false);
+        TupleDescInitEntry(tupdesc, (AttrNumber) 1, "result", proc->result.typeOid, -1, 0);
+    }
+    tupstore = tuplestore_begin_heap((rsi->allowedModes & SFRM_Materialize_Random) != 0, false, work_mem);
+    MemoryContextSwitchTo(oldcontext);
+
+    values = (Datum *) palloc(sizeof(Datum) * tupdesc->natts);
+    nulls = (bool *) palloc(sizeof(bool) * tupdesc->natts);
+    rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+                                       "PL/Container materialize row",
+                                       ALLOCSET_DEFAULT_MINSIZE,
+                                       ALLOCSET_DEFAULT_INITSIZE,
+                                       ALLOCSET_DEFAULT_MAXSIZE);
+
+    oldcontext = MemoryContextSwitchTo(rowcontext);
+    while ((chunk = stream->Current()) != NULL) {
+        const SetOfData &setof = chunk->results(0).setofvalue();
+        int nrows = PLContainerProtoUtils::SetOfRows(setof);
+
+        for (int row = chunk->result_rows(); row < nrows; row++) {
+            PLContainerProtoUtils::ValuesFromProtoSetOf(setof, row, &proc->result, values, nulls);
+            tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+            MemoryContextReset(rowcontext);
+        }
+        chunk->set_result_rows(nrows);
+    }
+    MemoryContextSwitchTo(oldcontext);
+    MemoryContextDelete(rowcontext);
+    pfree(values);
+    pfree(nulls);
+
+    rsi->returnMode = SFRM_Materialize;
+    rsi->setResult = tupstore;
+    rsi->setDesc = tupdesc;
+}
+
 Datum plcontainer_function_handler(FunctionCallInfo fcinfo, plcProcInfo *proc, MemoryContext function_cxt) {
     Datum datumreturn;
     MemoryContext volatile      oldcontext = CurrentMemoryContext;
@@ -447,28 +1172,74 @@ Datum plcontainer_function_handler(FunctionCallInfo fcinfo, plcProcInfo *proc, M
     bool     volatile               bFirstTimeCall = false;
     char *runtime_id;
     plcContext *ctx = NULL;
-    CallRequest     request;
+    google::protobuf::Arena *arena;
+    CallRequest     *request;
     CallResponse    * volatile  response = NULL;
+    PLContainerResultStream * volatile stream = NULL;
     PLContainerClient * volatile client = NULL;
+    ReturnSetInfo *rsi = (ReturnSetInfo *) fcinfo->resultinfo;
+    bool     volatile               bMaterialize = false;
+
+    if (PLContainerBatch::IsBatchable(fcinfo, proc)) {
+        oldcontext = MemoryContextSwitchTo(function_cxt);
+        runtime_id = parse_container_meta(proc->src);
+        ctx = get_container_context(runtime_id);
+        PLContainerBatch::GetPLContainerBatch()->Append(fcinfo, proc, R, ctx);
+        MemoryContextSwitchTo(oldcontext);
+        // void result, fcinfo->isnull is already set by the call handler
+        return (Datum) 0;
+    }
+
+    // deferred rows must have run before anything that may observe them
+    PLContainerBatch::GetPLContainerBatch()->Sync();
+
+    // request and response of this call, released on every way out
+    arena = PLContainerArena::Acquire();
+    request = google::protobuf::Arena::CreateMessage<CallRequest>(arena);
 
     PG_TRY();
     {
         // 1. initialize function handler context, both return set or not
-        plc_elog(DEBUG1, "fcinfo->flinfo->fn_retset: %d", fcinfo->flinfo->fn_retset);
+        plc_elog_lazy(DEBUG1, "fcinfo->flinfo->fn_retset: %d", fcinfo->flinfo->fn_retset);
 
-        if (fcinfo->flinfo->fn_retset) {
+        if (fcinfo->flinfo->fn_retset && plcontainer_can_materialize(rsi, proc)) {
+            // the whole set is returned in a tuplestore by this single call
+            bMaterialize = true;
+            oldcontext = MemoryContextSwitchTo(function_cxt);
+            runtime_id = parse_container_meta(proc->src);
+            ctx = get_container_context(runtime_id);
+            client = PLContainerClient::GetPLContainerClient();
+            client->Init(ctx);
+            client->InitCallRequest(fcinfo, proc, R, *request);
+            client->PrepareFunction(proc, *request);
+            stream = new PLContainerResultStream(client);
+
+            plcContextBeginStage(ctx, "R_function_call_materialize", NULL);
+            stream->Start(*request);
+            plcontainer_materialize_result(fcinfo, proc, stream);
+            plcContextEndStage(ctx, "R_function_call_materialize",
+                    PLC_CONTEXT_STAGE_SUCCESS,
+                    "[REQUEST]:%s", PLContainerProtoUtils::TraceSummary(*request).c_str());
+
+            plcContextLogging(LOG, ctx);
+            delete stream;
+            stream = NULL;
+            fcinfo->isnull = true;
+            datumreturn = (Datum) 0;
+            MemoryContextSwitchTo(oldcontext);
+        } else if (fcinfo->flinfo->fn_retset) {
             /* First Call setup */
             if (SRF_IS_FIRSTCALL())
             {
                 funcctx = SRF_FIRSTCALL_INIT();
                 bFirstTimeCall = true;
 
-                plc_elog(DEBUG1, "The funcctx pointer returned by SRF_FIRSTCALL_INIT() is: %p", funcctx);
+                plc_elog_lazy(DEBUG1, "The funcctx pointer returned by SRF_FIRSTCALL_INIT() is: %p", funcctx);
             }
 
             /* Every call setup */
             funcctx = SRF_PERCALL_SETUP();
-            plc_elog(DEBUG1, "The funcctx pointer returned by SRF_PERCALL_SETUP() is: %p", funcctx);
+            plc_elog_lazy(DEBUG1, "The funcctx pointer returned by SRF_PERCALL_SETUP() is: %p", funcctx);
 
             Assert(funcctx != NULL);
             /* SRF uses multi_call_memory_ctx context shared between function calls,
@@ -481,75 +1252,87 @@ Datum plcontainer_function_handler(FunctionCallInfo fcinfo, plcProcInfo *proc, M
             oldcontext = MemoryContextSwitchTo(function_cxt);
         }
 
-        if (!fcinfo->flinfo->fn_retset || bFirstTimeCall) {
+        if (bMaterialize) {
+            // done above
+        } else if (!fcinfo->flinfo->fn_retset) {
             runtime_id = parse_container_meta(proc->src);
             ctx = get_container_context(runtime_id);
-            /*
-             * TODO will be reuse client channel if possible
-             */
             client = PLContainerClient::GetPLContainerClient();
             client->Init(ctx);
-            client->InitCallRequest(fcinfo, proc, R, request);
-            response = new CallResponse;
+            client->InitCallRequest(fcinfo, proc, R, *request);
+            client->PrepareFunction(proc, *request);
+            response = google::protobuf::Arena::CreateMessage<CallResponse>(arena);
             response->set_result_rows(0);
- 
+
             plcContextBeginStage(ctx, "R_function_call", NULL);
-            client->FunctionCall(request, *response);
+            client->FunctionCall(*request, *response);
             plcContextEndStage(ctx, "R_function_call",
                     PLC_CONTEXT_STAGE_SUCCESS,
-                    "[REQUEST]:%s, [RESPONSE]:%s", request.DebugString().c_str(), response->DebugString().c_str());
+                    "[REQUEST]:%s, [RESPONSE]:%s", PLContainerProtoUtils::TraceSummary(*request).c_str(), PLContainerProtoUtils::TraceSummary(*response).c_str());
+
+            plcContextLogging(LOG, ctx);
+        } else if (bFirstTimeCall) {
+            plc_elog_lazy(DEBUG1, "first time call, preparing the result set...");
+
+            /* first time -- do checks and setup */
+            if (!rsi || !IsA(rsi, ReturnSetInfo)
+                    || (rsi->allowedModes & SFRM_ValuePerCall) == 0) {
+                ereport(ERROR,
+                        (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg(
+                                "unsupported set function return mode"), errdetail(
+                                "PL/Python set-returning functions only support returning only value per call.")));
+            }
+            rsi->returnMode = SFRM_ValuePerCall;
+
+            runtime_id = parse_container_meta(proc->src);
+            ctx = get_container_context(runtime_id);
+            client = PLContainerClient::GetPLContainerClient();
+            client->Init(ctx);
+            client->InitCallRequest(fcinfo, proc, R, *request);
+            client->PrepareFunction(proc, *request);
+
+            /*
+             * The rows are read chunk by chunk while the executor asks for them,
+             * the stream is released by the callback if it stops early.
+             */
+            stream = new PLContainerResultStream(client);
+            funcctx->user_fctx = (void *) stream;
+            RegisterExprContextCallback(rsi->econtext, plcontainer_result_stream_shutdown, PointerGetDatum(stream));
+
+            plcContextBeginStage(ctx, "R_function_call_stream", NULL);
+            stream->Start(*request);
+            plcContextEndStage(ctx, "R_function_call_stream",
+                    PLC_CONTEXT_STAGE_SUCCESS,
+                    "[REQUEST]:%s", PLContainerProtoUtils::TraceSummary(*request).c_str());
 
             plcContextLogging(LOG, ctx);
             bFirstTimeCall = false;
         }
 
-        if (fcinfo->flinfo->fn_retset) {
-            ReturnSetInfo *rsi = (ReturnSetInfo *) fcinfo->resultinfo;
-
-            if (funcctx->user_fctx == NULL) {
-                plc_elog(DEBUG1, "first time call, preparing the result set...");
-
-                /* first time -- do checks and setup */
-                if (!rsi || !IsA(rsi, ReturnSetInfo)
-                        || (rsi->allowedModes & SFRM_ValuePerCall) == 0) {
-                    ereport(ERROR,
-                            (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg(
-                                    "unsupported set function return mode"), errdetail(
-                                    "PL/Python set-returning functions only support returning only value per call.")));
-                }
-                rsi->returnMode = SFRM_ValuePerCall;
-
-                funcctx->user_fctx = (void *) response;
-
-                if (funcctx->user_fctx == NULL)
-                    ereport(ERROR,
-                            (errcode(ERRCODE_DATATYPE_MISMATCH), errmsg(
-                                    "returned object cannot be iterated"), errdetail(
-                                    "PL/Python set-returning functions must return an iterable object.")));
-            }
+        if (fcinfo->flinfo->fn_retset && !bMaterialize) {
+            stream = (PLContainerResultStream *) funcctx->user_fctx;
+            response = stream->Current();
 
-            response = (CallResponse *) funcctx->user_fctx;
-            if (response->results_size() > 0
-                && response->result_rows() < response->results(0).setofvalue().rowvalues_size()) {
-                rsi->isDone = ExprMultipleResult;
-            } else {
+            if (response == NULL) {
                 rsi->isDone = ExprEndResult;
-            }
-
-            if (rsi->isDone == ExprEndResult) {
                 MemoryContextSwitchTo(oldcontext);
 
-                delete response;
+                UnregisterExprContextCallback(rsi->econtext, plcontainer_result_stream_shutdown, PointerGetDatum(stream));
+                delete stream;
                 funcctx->user_fctx = NULL;
 
+                PLContainerArena::Release();
                 SRF_RETURN_DONE(funcctx);
             }
+            rsi->isDone = ExprMultipleResult;
         }
 
         /* Process the result message from client */
-        datumreturn = client->GetCallResponseAsDatum(fcinfo, proc, *response);
-        response->set_result_rows(response->result_rows() + 1);
-        MemoryContextSwitchTo(oldcontext);
+        if (!bMaterialize) {
+            datumreturn = PLContainerClient::GetCallResponseAsDatum(fcinfo, proc, *response);
+            response->set_result_rows(response->result_rows() + 1);
+            MemoryContextSwitchTo(oldcontext);
+        }
     }
     PG_CATCH();
     {
@@ -558,34 +1341,55 @@ Datum plcontainer_function_handler(FunctionCallInfo fcinfo, plcProcInfo *proc, M
          * yet. Set it to NULL so the next invocation of the function will
          * start the iteration again.
          */
-        if (fcinfo->flinfo->fn_retset && funcctx->user_fctx != NULL) {
+        if (fcinfo->flinfo->fn_retset && funcctx != NULL && funcctx->user_fctx != NULL) {
+            stream = (PLContainerResultStream *) funcctx->user_fctx;
+            UnregisterExprContextCallback(rsi->econtext, plcontainer_result_stream_shutdown, PointerGetDatum(stream));
+            delete stream;
             funcctx->user_fctx = NULL;
+        } else if (bMaterialize && stream) {
+            delete stream;
         }
-       
-        if (response) {
-            delete response;
-        }
- 
+        PLContainerArena::Release();
+
         MemoryContextSwitchTo(oldcontext);
         PG_RE_THROW();
     }
     PG_END_TRY();
-    
-    if (fcinfo->flinfo->fn_retset) {
+
+    PLContainerArena::Release();
+    if (bMaterialize) {
+        return datumreturn;
+    } else if (fcinfo->flinfo->fn_retset) {
         SRF_RETURN_NEXT(funcctx, datumreturn);
     } else {
-        delete response;
         return datumreturn;
     }
 }
 
+void plcontainer_flush_batch(void) {
+    PLContainerBatch::GetPLContainerBatch()->Sync();
+}
+
+void plcontainer_discard_batch(void) {
+    PLContainerBatch::GetPLContainerBatch()->Discard();
+}
+
+void plcontainer_discard_subxact_batch(SubTransactionId subid) {
+    PLContainerBatch::GetPLContainerBatch()->DiscardSubTransaction(subid);
+}
+
+void plcontainer_release_channel(const char *address) {
+    PLContainerClient::GetPLContainerClient()->ReleaseChannel(address);
+}
+
 void plcontainer_inline_function_handler(FunctionCallInfo fcinfo, MemoryContext function_cxt) {
     const InlineCodeBlock * const icb = (InlineCodeBlock *)PG_GETARG_POINTER(0);
     MemoryContext volatile      oldcontext = CurrentMemoryContext;
     char *runtime_id;
     plcContext *ctx = NULL;
-    CallRequest     request;
-    CallResponse    response;
+    google::protobuf::Arena *arena = PLContainerArena::Acquire();
+    CallRequest     *request = google::protobuf::Arena::CreateMessage<CallRequest>(arena);
+    CallResponse    *response = google::protobuf::Arena::CreateMessage<CallResponse>(arena);
     PLContainerClient * client = NULL;
     
     PG_TRY();
@@ -598,29 +1402,34 @@ void plcontainer_inline_function_handler(FunctionCallInfo fcinfo, MemoryContext
             plc_elog(ERROR, "plcontainer inline function param error");
         } 
 
+        PLContainerBatch::GetPLContainerBatch()->Sync();
+
         oldcontext = MemoryContextSwitchTo(function_cxt);
         runtime_id = parse_container_meta(icb->source_text);
         ctx = get_container_context(runtime_id);
        
         client = PLContainerClient::GetPLContainerClient(); 
         client->Init(ctx);
-        client->InitCallRequest(fcinfo, R, request);
+        client->InitCallRequest(fcinfo, R, *request);
         
         plcContextBeginStage(ctx, "R_inline_function", NULL);
-        client->FunctionCall(request, response);
+        client->FunctionCall(*request, *response);
         plcContextEndStage(ctx, "R_inline_function",
                     PLC_CONTEXT_STAGE_SUCCESS,
-                    "[REQUEST]:%s, [RESPONSE]:%s", request.DebugString().c_str(), response.DebugString().c_str());
+                    "[REQUEST]:%s, [RESPONSE]:%s", PLContainerProtoUtils::TraceSummary(*request).c_str(), PLContainerProtoUtils::TraceSummary(*response).c_str());
 
         plcContextLogging(LOG, ctx);
         MemoryContextSwitchTo(oldcontext);
     }
     PG_CATCH();
     {
+        PLContainerArena::Release();
         MemoryContextSwitchTo(oldcontext);
         PG_RE_THROW();
     }
     PG_END_TRY();
+
+    PLContainerArena::Release();
 }
 
 int get_new_container_from_coordinator(const char *runtime_id, plcContext *ctx) {
@@ -633,9 +1442,7 @@ int get_new_container_from_coordinator(const char *runtime_id, plcContext *ctx)
 #ifndef PLC_PG
 	dbid = (int)GpIdentity.dbid;
 #endif
-    std::string server_addr = get_coordinator_address();
-    PLCoordinatorClient     client(grpc::CreateChannel(
-      "unix://"+server_addr, grpc::InsecureChannelCredentials()));
+    PLCoordinatorClient *client = PLCoordinatorClient::GetPLCoordinatorClient(get_coordinator_address());
 
     username = GetUserNameFromId(GetUserId());
     request.set_runtime_id(runtime_id);
@@ -644,44 +1451,106 @@ int get_new_container_from_coordinator(const char *runtime_id, plcContext *ctx)
     request.set_command_count(gp_command_count);
     request.set_ownername(username);
     request.set_dbid(dbid);
-    client.StartContainer(request, response);
+    client->StartContainer(request, response);
 
     plcContextEndStage(ctx, "request_coordinator_for_container",
                     response.status() == 0 ? PLC_CONTEXT_STAGE_SUCCESS : PLC_CONTEXT_STAGE_FAIL,
-                    "[REQUEST]:%s, [RESPONSE]:%s", request.DebugString().c_str(), response.DebugString().c_str());
+                    "[REQUEST]:%s, [RESPONSE]:%s", PLContainerProtoUtils::TraceSummary(request).c_str(), PLContainerProtoUtils::TraceSummary(response).c_str());
 
     if (response.status() != 0) {
         return -1;
     }
     ctx->service_address = plc_top_strdup(response.container_address().c_str());
     ctx->container_id = plc_top_strdup(response.container_id().c_str());
+    ctx->command_count = request.command_count();
+    ctx->generation = response.generation();
+    // kept for the release, which may run where the catalog cannot be read
+    if (ctx->owner) {
+        pfree(ctx->owner);
+    }
+    ctx->owner = plc_top_strdup(username);
     return 0;
 }
 
+/*
+ * Hand the container of ctx back to the coordinator for reuse. Called while
+ * cleaning up after an ERROR or at backend exit, so failures are only logged
+ * and nothing is looked up in the catalog.
+ */
+void plcontainer_release_container(const char *runtime_id, const plcContext *ctx, int timeout_ms) {
+    ReleaseContainerRequest     request;
+    ReleaseContainerResponse    response;
+
+    if (ctx->container_id == NULL || ctx->service_address == NULL || ctx->owner == NULL) {
+        return;
+    }
+    PLCoordinatorClient *client = PLCoordinatorClient::GetPLCoordinatorClient(get_coordinator_address());
+
+    request.set_qe_pid(getpid());
+    request.set_session_id(gp_session_id);
+    request.set_command_count(ctx->command_count);
+    request.set_runtime_id(runtime_id);
+    request.set_ownername(ctx->owner);
+    request.set_container_id(ctx->container_id);
+    request.set_container_address(ctx->service_address);
+    request.set_generation(ctx->generation);
+    client->ReleaseContainer(request, response, timeout_ms);
+}
+
 PLCoordinatorClient::PLCoordinatorClient(std::shared_ptr<grpc::Channel> channel) {
     this->stub_ = PLCoordinator::NewStub(channel);
 }
 
+PLCoordinatorClient *PLCoordinatorClient::client = NULL;
+std::string PLCoordinatorClient::address;
+
+// one channel to the coordinator per backend, rebuilt only if its address changes
+PLCoordinatorClient *PLCoordinatorClient::GetPLCoordinatorClient(const std::string &server_addr) {
+    if (client != NULL && address != server_addr) {
+        delete client;
+        client = NULL;
+    }
+    if (client == NULL) {
+        client = new PLCoordinatorClient(grpc::CreateChannel(
+                        "unix://"+server_addr, grpc::InsecureChannelCredentials()));
+        address = server_addr;
+    }
+    return client;
+}
+
 void PLCoordinatorClient::StartContainer(const StartContainerRequest &request, StartContainerResponse &response) {
     grpc::ClientContext context;
-    plc_elog(DEBUG1, "StartContainer request:%s", request.DebugString().c_str());
+    plc_elog_lazy(DEBUG1, "StartContainer request:%s", PLContainerProtoUtils::TracePayload(request).c_str());
     grpc::Status status = stub_->StartContainer(&context, request, &response);
     if (!status.ok()) {
         response.set_status(1);
         plc_elog(ERROR, "StartContainer RPC failed., error:%s", status.error_message().c_str());
     }
-    plc_elog(DEBUG1, "StartContainer response:%s", response.DebugString().c_str());
-    plc_elog(DEBUG1, "StartContainer finished with status %d", status.error_code());
+    plc_elog_lazy(DEBUG1, "StartContainer response:%s", PLContainerProtoUtils::TracePayload(response).c_str());
+    plc_elog_lazy(DEBUG1, "StartContainer finished with status %d", status.error_code());
+}
+
+void PLCoordinatorClient::ReleaseContainer(const ReleaseContainerRequest &request, ReleaseContainerResponse &response, int timeout_ms) {
+    grpc::ClientContext context;
+    plc_elog_lazy(DEBUG1, "ReleaseContainer request:%s", PLContainerProtoUtils::TracePayload(request).c_str());
+    context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms));
+    grpc::Status status = stub_->ReleaseContainer(&context, request, &response);
+    if (!status.ok()) {
+        // the container goes away with the QE, as without reuse
+        plc_elog(LOG, "ReleaseContainer RPC failed., error:%s", status.error_message().c_str());
+        response.set_status(1);
+    }
+    plc_elog_lazy(DEBUG1, "ReleaseContainer finished with status %d", status.error_code());
 }
 
 void PLCoordinatorClient::StopContainer(const StopContainerRequest &request, StopContainerResponse &response) {
     grpc::ClientContext context;
-    plc_elog(DEBUG1, "StopContainer request:%s", request.DebugString().c_str());
+    plc_elog_lazy(DEBUG1, "StopContainer request:%s", PLContainerProtoUtils::TracePayload(request).c_str());
     grpc::Status status = stub_->StopContainer(&context, request, &response);
     if (!status.ok()) {
         plc_elog(ERROR, "StopContainer RPC failed., error:%s", status.error_message().c_str());
         response.set_status(1);
     }
-    plc_elog(DEBUG2, "StopContainer response:%s", response.DebugString().c_str());
-    plc_elog(DEBUG1, "StopContainer finished with status %d", status.error_code());
+    plc_elog_lazy(DEBUG2, "StopContainer response:%s", PLContainerProtoUtils::TracePayload(response).c_str());
+    plc_elog_lazy(DEBUG1, "StopContainer finished with status %d", status.error_code());
 }
@@ -7,7 +7,7 @@ char *plc_datum_as_udt(Datum input, plcTypeInfo *type) {
     char *result = (char *)palloc(sizeof(int) + size);
     *(int *)result = size;
     udt.SerializeToArray(result+sizeof(int), size);
-    plc_elog(DEBUG1, "plc_datum_as_udt call, size:%d", size);
+    plc_elog_lazy(DEBUG1, "plc_datum_as_udt call, size:%d", size);
     return result;
 }
 
@@ -25,7 +25,7 @@ char *plc_datum_as_array(Datum input, plcTypeInfo *type) {
         result = (char *)palloc(sizeof(int) + size);
         *(int *)result = size;
         setof.SerializeToArray(result+sizeof(int), size);
-        plc_elog(DEBUG1, "plc_datum_as_array call, setof size:%d", size);
+        plc_elog_lazy(DEBUG1, "plc_datum_as_array call, setof size:%d", size);
 
     } else {
         ArrayData arr;
@@ -34,7 +34,7 @@ char *plc_datum_as_array(Datum input, plcTypeInfo *type) {
         result = (char *)palloc(sizeof(int) + size);
         *(int *)result = size;
         arr.SerializeToArray(result+sizeof(int), size);
-        plc_elog(DEBUG1, "plc_datum_as_array call, size:%d", size);
+        plc_elog_lazy(DEBUG1, "plc_datum_as_array call, size:%d", size);
     }
 
     return result;
@@ -50,6 +50,46 @@ Datum plc_datum_from_array(char *input, plcTypeInfo *type) {
     }
 }
 
+/*
+ * Text dump of a message for the trace logs. Only every
+ * plcontainer.trace_payload_interval-th message is dumped and the dump
+ * stops after plcontainer.trace_payload_size bytes, the other messages are
+ * summarized by their type and size.
+ */
+std::string PLContainerProtoUtils::TracePayload(const google::protobuf::Message &msg) {
+    static uint64 traced = 0;
+    std::string summary = PLContainerProtoUtils::TraceSummary(msg);
+
+    if (::plc_trace_payload_size == 0 || (traced++ % ::plc_trace_payload_interval) != 0) {
+        return summary;
+    }
+
+    google::protobuf::TextFormat::Printer printer;
+    printer.SetSingleLineMode(true);
+    if (::plc_trace_payload_size < 0) {
+        std::string text;
+        printer.PrintToString(msg, &text);
+        return summary + " " + text;
+    }
+
+    // printing stops at the end of the buffer instead of rendering the whole message
+    std::string text(::plc_trace_payload_size, '\0');
+    google::protobuf::io::ArrayOutputStream output(&text[0], text.size());
+    printer.SetTruncateStringFieldLongerThan(::plc_trace_payload_size);
+    bool complete = printer.Print(msg, &output);
+    text.resize(output.ByteCount());
+    return summary + " " + text + (complete ? "" : "...");
+}
+
+// type and size of a message, cheap enough for the stage messages logged on every call
+std::string PLContainerProtoUtils::TraceSummary(const google::protobuf::Message &msg) {
+    char summary[256];
+
+    snprintf(summary, sizeof(summary), "%s(%lu bytes)",
+                    msg.GetTypeName().c_str(), (unsigned long)msg.ByteSizeLong());
+    return summary;
+}
+
 PlcDataType PLContainerProtoUtils::GetDataType(const plcTypeInfo *type) {
     PlcDataType ret = UNKNOWN;
     switch (type->type) {
@@ -111,7 +151,7 @@ bool PLContainerProtoUtils::isSetOf(const plcTypeInfo *type) {
 }
 
 void PLContainerProtoUtils::SetScalarValue(ScalarData &data, const char *name, bool isnull, const plcTypeInfo *type, const char *value) {
-    plc_elog(DEBUG1, "set scalar value, name:%s isnull:%d type:%d, value:%p", 
+    plc_elog_lazy(DEBUG1, "set scalar value, name:%s isnull:%d type:%d, value:%p", 
                 name ? name : "null",
                 isnull,
                 type->type,
@@ -143,10 +183,19 @@ void PLContainerProtoUtils::SetScalarValue(ScalarData &data, const char *name, b
             data.set_realvalue(*(float *)value);
             break;
         case PLC_DATA_INT8:
-            data.set_realvalue(*(int64_t *)value);
+            if (::plc_lossless_numeric) {
+                data.set_int64value(*(int64_t *)value);
+            } else {
+                data.set_realvalue(*(int64_t *)value);
+            }
             break;
         case PLC_DATA_FLOAT8:
-            data.set_realvalue(*(double *)value);
+            if (type->typeOid == NUMERICOID && ::plc_lossless_numeric) {
+                // DatumOutput() returned the bytea of numeric_send
+                data.set_numericvalue(VARDATA(value), VARSIZE(value) - VARHDRSZ);
+            } else {
+                data.set_realvalue(*(double *)value);
+            }
             break;
         case PLC_DATA_TEXT:
             data.set_stringvalue(value);
@@ -160,6 +209,259 @@ void PLContainerProtoUtils::SetScalarValue(ScalarData &data, const char *name, b
     }
 }
 
+bool PLContainerProtoUtils::IsColumnType(const plcTypeInfo *type) {
+    switch (type->type) {
+    case PLC_DATA_INT1:
+    case PLC_DATA_INT2:
+    case PLC_DATA_INT4:
+    case PLC_DATA_INT8:
+    case PLC_DATA_FLOAT4:
+    case PLC_DATA_FLOAT8:
+    case PLC_DATA_TEXT:
+    case PLC_DATA_BYTEA:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void PLContainerProtoUtils::InitProtoColumn(ColumnData &col, const char *name, const plcTypeInfo *type) {
+    // bigint travels in the integer vector, so it is not tagged as REAL here
+    col.set_type(type->type == PLC_DATA_INT8 ? INT : PLContainerProtoUtils::GetDataType(type));
+    if (name) {
+        col.set_name(name);
+    } else {
+        col.set_name("");
+    }
+}
+
+/*
+ * Append the value of row 'row' to the column. Fixed width values are taken
+ * from the Datum directly instead of going through the type's outfunc.
+ */
+void PLContainerProtoUtils::AppendDatumToColumn(ColumnData &col, int row, Datum input, bool isnull, const plcTypeInfo *type) {
+    if (isnull) {
+        std::string *nulls = col.mutable_nulls();
+        if ((int)nulls->size() <= row / 8) {
+            nulls->resize(row / 8 + 1, '\0');
+        }
+        (*nulls)[row / 8] |= (char)(1 << (row % 8));
+    }
+
+    switch (type->type) {
+    case PLC_DATA_INT1:
+        col.add_logicalvalues(isnull ? false : DatumGetBool(input));
+        break;
+    case PLC_DATA_INT2:
+        col.add_intvalues(isnull ? 0 : DatumGetInt16(input));
+        break;
+    case PLC_DATA_INT4:
+        col.add_intvalues(isnull ? 0 : DatumGetInt32(input));
+        break;
+    case PLC_DATA_INT8:
+        col.add_intvalues(isnull ? 0 : DatumGetInt64(input));
+        break;
+    case PLC_DATA_FLOAT4:
+        col.add_realvalues(isnull ? 0 : DatumGetFloat4(input));
+        break;
+    case PLC_DATA_FLOAT8:
+        if (type->typeOid == NUMERICOID && ::plc_lossless_numeric) {
+            if (isnull) {
+                col.add_numericvalues("");
+            } else {
+                bytea *value = DatumGetByteaP(DirectFunctionCall1(numeric_send, input));
+                col.add_numericvalues(VARDATA(value), VARSIZE(value) - VARHDRSZ);
+                pfree(value);
+            }
+        } else if (isnull) {
+            col.add_realvalues(0);
+        } else if (type->typeOid == NUMERICOID) {
+            col.add_realvalues(DatumGetFloat8(DirectFunctionCall1(numeric_float8, input)));
+        } else {
+            col.add_realvalues(DatumGetFloat8(input));
+        }
+        break;
+    case PLC_DATA_TEXT:
+        if (isnull) {
+            col.add_stringvalues("");
+        } else {
+            char *value = type->outfunc(input, (plcTypeInfo *)type);
+            col.add_stringvalues(value);
+            pfree(value);
+        }
+        break;
+    case PLC_DATA_BYTEA:
+        if (isnull) {
+            col.add_byteavalues("");
+        } else {
+            bytea *value = DatumGetByteaP(input);
+            col.add_byteavalues(VARDATA(value), VARSIZE(value) - VARHDRSZ);
+            if ((Pointer)value != DatumGetPointer(input)) {
+                pfree(value);
+            }
+        }
+        break;
+    default:
+        plc_elog(ERROR, "invalid data type %d in column data", type->type);
+    }
+}
+
+// a column sent by a runtime may be shorter than the row count it claims
+void PLContainerProtoUtils::checkColumnSize(const ColumnData &col, int size, int row) {
+    if (row >= size) {
+        plc_elog(ERROR, "column %s has %d values, expect at least %d", col.name().c_str(), size, row + 1);
+    }
+}
+
+Datum PLContainerProtoUtils::DatumFromProtoColumn(const ColumnData &col, int row, plcTypeInfo *type, bool *isnull) {
+    const std::string &nulls = col.nulls();
+    PlcDataType expected = type->type == PLC_DATA_INT8 ? INT : PLContainerProtoUtils::GetDataType(type);
+
+    if (col.type() != expected) {
+        plc_elog(ERROR, "column %s has type %s, expect %s", col.name().c_str(),
+                 PlcDataType_Name(col.type()).c_str(), PlcDataType_Name(expected).c_str());
+    }
+
+    *isnull = (row / 8 < (int)nulls.size()) && (nulls[row / 8] & (1 << (row % 8)));
+    if (*isnull) {
+        return (Datum)0;
+    }
+
+    switch (type->type) {
+    case PLC_DATA_INT1:
+        PLContainerProtoUtils::checkColumnSize(col, col.logicalvalues_size(), row);
+        return BoolGetDatum(col.logicalvalues(row));
+    case PLC_DATA_INT2:
+        PLContainerProtoUtils::checkColumnSize(col, col.intvalues_size(), row);
+        return Int16GetDatum((int16)col.intvalues(row));
+    case PLC_DATA_INT4:
+        PLContainerProtoUtils::checkColumnSize(col, col.intvalues_size(), row);
+        return Int32GetDatum((int32)col.intvalues(row));
+    case PLC_DATA_INT8:
+        PLContainerProtoUtils::checkColumnSize(col, col.intvalues_size(), row);
+        return Int64GetDatum(col.intvalues(row));
+    case PLC_DATA_FLOAT4:
+        PLContainerProtoUtils::checkColumnSize(col, col.realvalues_size(), row);
+        return Float4GetDatum((float4)col.realvalues(row));
+    case PLC_DATA_FLOAT8:
+        if (type->typeOid == NUMERICOID) {
+            if (col.numericvalues_size() > 0) {
+                PLContainerProtoUtils::checkColumnSize(col, col.numericvalues_size(), row);
+                return PLContainerProtoUtils::numericFromBinary(col.numericvalues(row), type);
+            }
+            PLContainerProtoUtils::checkColumnSize(col, col.realvalues_size(), row);
+            return DirectFunctionCall1(float8_numeric, Float8GetDatum(col.realvalues(row)));
+        }
+        PLContainerProtoUtils::checkColumnSize(col, col.realvalues_size(), row);
+        return Float8GetDatum(col.realvalues(row));
+    case PLC_DATA_TEXT:
+        PLContainerProtoUtils::checkColumnSize(col, col.stringvalues_size(), row);
+        return OidFunctionCall3(type->input,
+                                CStringGetDatum(col.stringvalues(row).c_str()),
+                                type->typelem,
+                                type->typmod);
+    case PLC_DATA_BYTEA: {
+        PLContainerProtoUtils::checkColumnSize(col, col.byteavalues_size(), row);
+        const std::string &value = col.byteavalues(row);
+        bytea *result = (bytea *)palloc(value.size() + VARHDRSZ);
+        SET_VARSIZE(result, value.size() + VARHDRSZ);
+        memcpy(VARDATA(result), value.data(), value.size());
+        return PointerGetDatum(result);
+    }
+    default:
+        plc_elog(ERROR, "invalid data type %d in column data", type->type);
+    }
+
+    return (Datum)0;
+}
+
+/*
+ * Build the value of row 'row' out of a set sent column by column, a tuple
+ * for a composite type or the only column for a scalar.
+ */
+Datum PLContainerProtoUtils::DatumFromProtoColumns(const ColumnarData &cd, int row, plcTypeInfo *type, bool *isnull) {
+    TupleDesc desc;
+    HeapTuple tuple;
+    Datum *values;
+    bool *nulls;
+    Datum result;
+
+    if (type->type != PLC_DATA_UDT) {
+        PLContainerProtoUtils::ValuesFromProtoColumns(cd, row, type, &result, isnull);
+        return result;
+    }
+
+    values = (Datum *)palloc(sizeof(Datum) * type->nSubTypes);
+    nulls = (bool *)palloc(sizeof(bool) * type->nSubTypes);
+    PLContainerProtoUtils::ValuesFromProtoColumns(cd, row, type, values, nulls);
+
+    desc = lookup_rowtype_tupdesc(type->typeOid, type->typmod);
+    tuple = heap_form_tuple(desc, values, nulls);
+    ReleaseTupleDesc(desc);
+
+    pfree(values);
+    pfree(nulls);
+
+    *isnull = false;
+    return HeapTupleGetDatum(tuple);
+}
+
+/*
+ * Fill the attributes of row 'row', one per attribute of a composite type
+ * or a single one for a scalar.
+ */
+void PLContainerProtoUtils::ValuesFromProtoColumns(const ColumnarData &cd, int row, plcTypeInfo *type, Datum *values, bool *nulls) {
+    int i, j;
+
+    if (row < 0 || row >= cd.rows()) {
+        plc_elog(ERROR, "row %d is out of the %d rows of columnar data", row, cd.rows());
+    }
+
+    if (type->type != PLC_DATA_UDT) {
+        if (cd.columns_size() != 1) {
+            plc_elog(ERROR, "expect 1 column for scalar set, got %d", cd.columns_size());
+        }
+        values[0] = PLContainerProtoUtils::DatumFromProtoColumn(cd.columns(0), row, type, &nulls[0]);
+        return;
+    }
+
+    for (i = 0, j = 0; i < type->nSubTypes; ++i) {
+        if (type->subTypes[i].attisdropped) {
+            values[i] = (Datum) 0;
+            nulls[i] = true;
+            continue;
+        }
+        if (j >= cd.columns_size()) {
+            plc_elog(ERROR, "expect more than %d columns for composite type %s", cd.columns_size(), type->typeName);
+        }
+        values[i] = PLContainerProtoUtils::DatumFromProtoColumn(cd.columns(j), row, &type->subTypes[i], &nulls[i]);
+        j++;
+    }
+}
+
+// attributes of row 'row' of a set, whichever way its rows were sent
+void PLContainerProtoUtils::ValuesFromProtoSetOf(const SetOfData &setof, int row, plcTypeInfo *type, Datum *values, bool *nulls) {
+    if (setof.has_columnvalues()) {
+        PLContainerProtoUtils::ValuesFromProtoColumns(setof.columnvalues(), row, type, values, nulls);
+    } else if (type->type == PLC_DATA_UDT) {
+        PLContainerProtoUtils::ValuesFromProtoData(setof.rowvalues(row), type, values, nulls);
+    } else {
+        const CompositeData &cd = setof.rowvalues(row);
+        if (cd.values_size() != 1) {
+            plc_elog(ERROR, "expect 1 value for scalar set, got %d", cd.values_size());
+        }
+        nulls[0] = cd.values(0).isnull();
+        values[0] = PLContainerProtoUtils::DatumFromProtoData(cd.values(0), type);
+    }
+}
+
+int PLContainerProtoUtils::SetOfRows(const SetOfData &setof) {
+    if (setof.has_columnvalues()) {
+        return setof.columnvalues().rows();
+    }
+    return setof.rowvalues_size();
+}
+
 void PLContainerProtoUtils::DatumAsProtoData(Datum input, const plcTypeInfo *type, CompositeData &cd) {
     HeapTupleHeader rec_header;
     int i, j;
@@ -175,7 +477,7 @@ void PLContainerProtoUtils::DatumAsProtoData(Datum input, const plcTypeInfo *typ
             if (isnull) {
                 PLContainerProtoUtils::SetScalarValue(*sd, type->subTypes[i].typeName, true, &type->subTypes[i], NULL);
             } else {
-                PLContainerProtoUtils::SetScalarValue(*sd, type->subTypes[i].typeName, false, &type->subTypes[i], type->subTypes[i].outfunc(vattr, &type->subTypes[i]));
+                PLContainerProtoUtils::SetScalarValue(*sd, type->subTypes[i].typeName, false, &type->subTypes[i], PLContainerProtoUtils::DatumOutput(vattr, &type->subTypes[i]));
             }
             j++;
         }
@@ -207,6 +509,14 @@ void PLContainerProtoUtils::DatumAsProtoArrayOrSetOf(Datum input, const plcTypeI
     int nitems = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
     char *data = ARR_DATA_PTR(array);
     plcTypeInfo *elementType = &type->subTypes[0];
+    PackedElementType packedType;
+
+    if (!isSetOf && ::plc_packed_array
+        && PLContainerProtoUtils::packedElementType(elementType, &packedType)) {
+        ad->set_elementtype(PLContainerProtoUtils::GetDataType(elementType));
+        PLContainerProtoUtils::datumAsProtoPackedArray(array, elementType, packedType, *ad->mutable_packedvalues());
+        return;
+    }
 
     Datum itemvalue;
     int curitem = 0;
@@ -224,7 +534,7 @@ void PLContainerProtoUtils::DatumAsProtoArrayOrSetOf(Datum input, const plcTypeI
                 PLContainerProtoUtils::SetScalarValue(*sd, elementType->typeName, true, elementType, NULL);
             } else {
                 itemvalue = fetch_att(data, elementType->typbyval, elementType->typlen);
-                PLContainerProtoUtils::SetScalarValue(*sd, elementType->typeName, false, elementType, elementType->outfunc(itemvalue, elementType));
+                PLContainerProtoUtils::SetScalarValue(*sd, elementType->typeName, false, elementType, PLContainerProtoUtils::DatumOutput(itemvalue, elementType));
                 data = att_addlength_pointer(data, elementType->typlen, data);
                 data = (char *) att_align_nominal(data, elementType->typalign);
             }
@@ -253,6 +563,239 @@ void PLContainerProtoUtils::DatumAsProtoArrayOrSetOf(Datum input, const plcTypeI
     }
 }
 
+bool PLContainerProtoUtils::packedElementType(const plcTypeInfo *type, PackedElementType *packedType) {
+    switch (type->typeOid) {
+    case BOOLOID:
+        *packedType = PACKED_BOOL;
+        return true;
+    case INT2OID:
+        *packedType = PACKED_INT16;
+        return true;
+    case INT4OID:
+        *packedType = PACKED_INT32;
+        return true;
+    case INT8OID:
+        *packedType = PACKED_INT64;
+        return true;
+    case FLOAT4OID:
+        *packedType = PACKED_FLOAT32;
+        return true;
+    case FLOAT8OID:
+        *packedType = PACKED_FLOAT64;
+        return true;
+    default:
+        return false;
+    }
+}
+
+int PLContainerProtoUtils::packedElementWidth(PackedElementType packedType) {
+    switch (packedType) {
+    case PACKED_BOOL:
+        return sizeof(bool);
+    case PACKED_INT16:
+        return sizeof(int16);
+    case PACKED_INT32:
+        return sizeof(int32);
+    case PACKED_INT64:
+        return sizeof(int64);
+    case PACKED_FLOAT32:
+        return sizeof(float4);
+    case PACKED_FLOAT64:
+        return sizeof(float8);
+    default:
+        plc_elog(ERROR, "invalid packed array element type %d", packedType);
+    }
+    return 0;
+}
+
+/*
+ * The element types handled here are aligned to their own width, so the
+ * elements of an array without nulls already lie back to back in the array
+ * body and are copied in one go.
+ */
+void PLContainerProtoUtils::datumAsProtoPackedArray(ArrayType *array, const plcTypeInfo *elementType, PackedElementType packedType, PackedArrayData &pd) {
+    int nitems = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
+    int width = elementType->typlen;
+    bits8 *bitmap = ARR_NULLBITMAP(array);
+    const char *data = ARR_DATA_PTR(array);
+
+    pd.set_elementtype(packedType);
+    pd.set_nelems(nitems);
+
+    if (bitmap == NULL) {
+        pd.set_values(data, (size_t)nitems * width);
+        return;
+    }
+
+    // null elements take no space in the array body, spread the others out
+    std::string *values = pd.mutable_values();
+    std::string *nulls = pd.mutable_nulls();
+    values->assign((size_t)nitems * width, '\0');
+    nulls->assign((nitems + 7) / 8, '\0');
+    for (int i=0;i<nitems;i++) {
+        if (bitmap[i / 8] & (1 << (i % 8))) {
+            memcpy(&(*values)[(size_t)i * width], data, width);
+            data += width;
+        } else {
+            (*nulls)[i / 8] |= (char)(1 << (i % 8));
+        }
+    }
+}
+
+Datum PLContainerProtoUtils::packedElementAsDatum(const char *value, PackedElementType packedType, plcTypeInfo *elementType) {
+    bool b;
+    int16 i16;
+    int32 i32;
+    int64 integer = 0;
+    float4 f4;
+    float8 real = 0;
+    bool isReal = false;
+
+    // memcpy since the buffer of a protobuf bytes field is not aligned
+    switch (packedType) {
+    case PACKED_BOOL:
+        memcpy(&b, value, sizeof(b));
+        integer = b;
+        break;
+    case PACKED_INT16:
+        memcpy(&i16, value, sizeof(i16));
+        integer = i16;
+        break;
+    case PACKED_INT32:
+        memcpy(&i32, value, sizeof(i32));
+        integer = i32;
+        break;
+    case PACKED_INT64:
+        memcpy(&integer, value, sizeof(integer));
+        break;
+    case PACKED_FLOAT32:
+        memcpy(&f4, value, sizeof(f4));
+        real = f4;
+        isReal = true;
+        break;
+    case PACKED_FLOAT64:
+        memcpy(&real, value, sizeof(real));
+        isReal = true;
+        break;
+    default:
+        plc_elog(ERROR, "invalid packed array element type %d", packedType);
+    }
+
+    switch (elementType->type) {
+    case PLC_DATA_INT1:
+        return BoolGetDatum(isReal ? real != 0 : integer != 0);
+    case PLC_DATA_INT2:
+        return Int16GetDatum(isReal ? (int16)real : (int16)integer);
+    case PLC_DATA_INT4:
+        return Int32GetDatum(isReal ? (int32)real : (int32)integer);
+    case PLC_DATA_INT8:
+        return Int64GetDatum(isReal ? (int64)real : integer);
+    case PLC_DATA_FLOAT4:
+        return Float4GetDatum(isReal ? (float4)real : (float4)integer);
+    case PLC_DATA_FLOAT8:
+        if (!isReal) {
+            real = (float8)integer;
+        }
+        if (elementType->typeOid == NUMERICOID) {
+            return DirectFunctionCall1(float8_numeric, Float8GetDatum(real));
+        }
+        return Float8GetDatum(real);
+    default:
+        plc_elog(ERROR, "packed array could not be converted to element type %s", elementType->typeName);
+    }
+    return (Datum)0;
+}
+
+Datum PLContainerProtoUtils::datumFromProtoPackedArray(const PackedArrayData &pd, plcTypeInfo *elementType) {
+    int         nelems = pd.nelems();
+    int         width = PLContainerProtoUtils::packedElementWidth(pd.elementtype());
+    const std::string &nulls = pd.nulls();
+    const char  *values = pd.values().data();
+    PackedElementType expected;
+    int         dims[1];
+    int         lbs[1];
+
+    if (nelems < 0 || pd.values().size() != (size_t)nelems * width) {
+        plc_elog(ERROR, "packed array of %d elements has %lu bytes", nelems, (unsigned long)pd.values().size());
+    }
+
+    dims[0] = nelems;
+    lbs[0] = 1;
+
+    // same layout as the array body, build the array around a single copy
+    if (nelems > 0 && nulls.empty()
+        && PLContainerProtoUtils::packedElementType(elementType, &expected)
+        && expected == pd.elementtype()) {
+        int nbytes = ARR_OVERHEAD_NONULLS(1) + nelems * width;
+        ArrayType *array = (ArrayType *)palloc0(nbytes);
+
+        SET_VARSIZE(array, nbytes);
+        array->ndim = 1;
+        array->dataoffset = 0;
+        array->elemtype = elementType->typeOid;
+        memcpy(ARR_DIMS(array), dims, sizeof(dims));
+        memcpy(ARR_LBOUND(array), lbs, sizeof(lbs));
+        memcpy(ARR_DATA_PTR(array), values, (size_t)nelems * width);
+        return PointerGetDatum(array);
+    }
+
+    Datum *elems = (Datum *)palloc(nelems * sizeof(Datum));
+    bool *isnull = (bool *)palloc(nelems * sizeof(bool));
+    for (int i=0;i<nelems;i++) {
+        isnull[i] = (i / 8 < (int)nulls.size()) && (nulls[i / 8] & (1 << (i % 8)));
+        if (isnull[i]) {
+            elems[i] = (Datum)0;
+        } else {
+            elems[i] = PLContainerProtoUtils::packedElementAsDatum(values + (size_t)i * width, pd.elementtype(), elementType);
+        }
+    }
+
+    ArrayType *array = construct_md_array(elems,
+                                        isnull,
+                                        1,
+                                        dims,
+                                        lbs,
+                                        elementType->typeOid,
+                                        elementType->typlen,
+                                        elementType->typbyval,
+                                        elementType->typalign);
+
+    pfree(elems);
+    pfree(isnull);
+
+    return PointerGetDatum(array);
+}
+
+/*
+ * The value SetScalarValue() expects for input. Numeric is sent in the binary
+ * format of numeric_send when plcontainer.lossless_numeric is on, the output
+ * function of the type converts it to float8.
+ */
+char *PLContainerProtoUtils::DatumOutput(Datum input, plcTypeInfo *type) {
+    if (type->typeOid == NUMERICOID && ::plc_lossless_numeric) {
+        return plc_datum_as_numeric_binary(input, type);
+    }
+    return type->outfunc(input, type);
+}
+
+/*
+ * Numeric from the binary format of numeric_send, without the text round
+ * trip of float8_numeric. The typmod of the type is applied as by a cast.
+ */
+Datum PLContainerProtoUtils::numericFromBinary(const std::string &value, const plcTypeInfo *type) {
+    StringInfoData buf;
+
+    // numeric_recv only reads the buffer, no need to copy it
+    buf.data = (char *)value.data();
+    buf.len = value.size();
+    buf.maxlen = value.size();
+    buf.cursor = 0;
+    return DirectFunctionCall3(numeric_recv,
+                               PointerGetDatum(&buf),
+                               ObjectIdGetDatum(InvalidOid),
+                               Int32GetDatum(type->typmod));
+}
+
 Datum PLContainerProtoUtils::DatumFromProtoData(const ScalarData &sd, plcTypeInfo *type, bool isArrayElement) {
     Datum retresult = (Datum)0;
 
@@ -260,6 +803,10 @@ Datum PLContainerProtoUtils::DatumFromProtoData(const ScalarData &sd, plcTypeInf
         return retresult;
     }
 
+    if (type->typeOid == NUMERICOID && sd.exact_case() == ScalarData::kNumericValue) {
+        return PLContainerProtoUtils::numericFromBinary(sd.numericvalue(), type);
+    }
+
     char *buffer = NULL;
     switch (type->type) {
     case PLC_DATA_INT1:
@@ -276,7 +823,11 @@ Datum PLContainerProtoUtils::DatumFromProtoData(const ScalarData &sd, plcTypeInf
         break;
     case PLC_DATA_INT8:
         buffer = (char *)palloc(8);
-        *(int64_t *)buffer = sd.realvalue();
+        if (sd.exact_case() == ScalarData::kInt64Value) {
+            *(int64_t *)buffer = sd.int64value();
+        } else {
+            *(int64_t *)buffer = (int64_t)sd.realvalue();
+        }
         break;
     case PLC_DATA_FLOAT4:
         buffer = (char *)palloc(4);
@@ -316,23 +867,11 @@ Datum PLContainerProtoUtils::DatumFromProtoData(const CompositeData &cd, plcType
     HeapTuple tuple;
     Datum *values;
     bool *nulls;
-    volatile int i, j;
     
     /* Build tuple */
     values = (Datum *)palloc(sizeof(Datum) * type->nSubTypes);
     nulls = (bool *)palloc(sizeof(bool) * type->nSubTypes);
-    for (i = 0, j = 0; i < type->nSubTypes; ++i) {
-        if (!type->subTypes[i].attisdropped) {
-            if (cd.values(i).isnull()) {
-                nulls[i] = true;
-                values[i] = (Datum) 0;
-            } else {
-                nulls[i] = false;
-                values[i] = PLContainerProtoUtils::DatumFromProtoData(cd.values(i), &type->subTypes[i]);
-            }
-            j++;
-        }
-    }
+    PLContainerProtoUtils::ValuesFromProtoData(cd, type, values, nulls);
 
     desc = lookup_rowtype_tupdesc(type->typeOid, type->typmod);
     tuple = heap_form_tuple(desc, values, nulls);
@@ -344,12 +883,43 @@ Datum PLContainerProtoUtils::DatumFromProtoData(const CompositeData &cd, plcType
     return HeapTupleGetDatum(tuple);
 }
 
+/*
+ * Fill the attributes of a composite type, dropped columns are not sent and
+ * come back as nulls.
+ */
+void PLContainerProtoUtils::ValuesFromProtoData(const CompositeData &cd, plcTypeInfo *type, Datum *values, bool *nulls) {
+    int i, j;
+
+    for (i = 0, j = 0; i < type->nSubTypes; ++i) {
+        if (type->subTypes[i].attisdropped) {
+            nulls[i] = true;
+            values[i] = (Datum) 0;
+            continue;
+        }
+        if (j >= cd.values_size()) {
+            plc_elog(ERROR, "expect more than %d values for composite type %s", cd.values_size(), type->typeName);
+        }
+        if (cd.values(j).isnull()) {
+            nulls[i] = true;
+            values[i] = (Datum) 0;
+        } else {
+            nulls[i] = false;
+            values[i] = PLContainerProtoUtils::DatumFromProtoData(cd.values(j), &type->subTypes[i]);
+        }
+        j++;
+    }
+}
+
 Datum PLContainerProtoUtils::DatumFromProtoData(const ArrayData &ad, plcTypeInfo *type) {
     Datum retresult = (Datum)0;
     int         dims[1];
     int         lbs[1];
 
     plcTypeInfo *subType = &type->subTypes[0];
+    if (ad.has_packedvalues()) {
+        return PLContainerProtoUtils::datumFromProtoPackedArray(ad.packedvalues(), subType);
+    }
+
     int nelems = ad.values_size();
     dims[0] = nelems;
     lbs[0] = 1;
@@ -1,8 +1,45 @@
 #include "docker/docker_client.h"
 
+static int check_json_fields(const char *name, const std::string &json, int result,
+                             const std::vector<std::string> &paths,
+                             const std::vector<std::vector<std::string>> &expected) {
+    std::vector<std::vector<std::string>> rows;
+    if (parseJsonFields(json, paths, rows) != result || (result == 0 && rows != expected)) {
+        std::cout << "failed! parseJsonFields " << name << std::endl;
+        return 1;
+    }
+    std::cout << "success! parseJsonFields " << name << std::endl;
+    return 0;
+}
+
+/* no docker needed, only the SAX handler picking fields out of responses */
+static int test_parse_json_fields() {
+    int failed = 0;
+
+    failed += check_json_fields("top level array",
+                                "[{\"Id\":\"a\",\"State\":\"running\"},{\"Id\":\"b\",\"State\":\"exited\"}]", 0,
+                                {"Id", "State"}, {{"a", "running"}, {"b", "exited"}});
+    failed += check_json_fields("top level object",
+                                "{\"Id\":\"c\",\"State\":{\"Status\":\"running\",\"Pid\":42}}", 0,
+                                {"Id", "State/Status", "State/Pid"}, {{"c", "running", "42"}});
+    failed += check_json_fields("nested arrays",
+                                "[{\"Id\":\"d\",\"Names\":[\"/x\",\"/y\"],\"Ports\":[{\"Id\":\"p\"}],\"Labels\":{\"dbid\":\"1\"}}]", 0,
+                                {"Id", "Labels/dbid"}, {{"d", "1"}});
+    failed += check_json_fields("missing field",
+                                "{\"Id\":\"e\"}", 0,
+                                {"Id", "State"}, {{"e", ""}});
+    failed += check_json_fields("invalid json",
+                                "[{\"Id\":", -1,
+                                {"Id"}, {});
+    return failed;
+}
+
 int main() {
     JSON_DOC doc;
-    Docker client = Docker();
+    Docker client;
+    if (test_parse_json_fields() != 0) {
+        return 1;
+    }
     std::vector<std::string> container_ids;
     JSON_DOC param(rapidjson::kObjectType);
     JSON_VAL commands(rapidjson::kArrayType);
@@ -0,0 +1,21 @@
+-- batches of scalar arguments are sent column by column
+SET plcontainer.batch_size = 4;
+
+CREATE OR REPLACE FUNCTION rbatch_columns(i int4, b int8, f float8, t text) RETURNS void AS $$
+# container: plc_r_shared
+if (b != i * 10 || f != i / 2) stop('wrong number')
+if (i %% 3 == 0) {
+    if (!is.na(t)) stop('null expected')
+} else if (t != paste0('row', i)) {
+    stop('wrong text')
+}
+$$ LANGUAGE plcontainer;
+
+select i, rbatch_columns(i, i * 10, i / 2.0, case when i % 3 = 0 then null else 'row' || i end)
+from generate_series(1,6) i;
+-- the row of a wrong value is found in its column
+select i, rbatch_columns(i, i * 10, i / 2.0, 'row1') from generate_series(1,2) i;
+
+RESET plcontainer.batch_size;
+
+DROP FUNCTION rbatch_columns(int4, int8, float8, text);
@@ -0,0 +1,23 @@
+-- void functions run in batches of plcontainer.batch_size rows
+SET plcontainer.batch_size = 4;
+
+CREATE OR REPLACE FUNCTION rbatch_void(i int4, a int4[]) RETURNS void AS $$
+# container: plc_r_shared
+if (length(a) != i) stop('wrong length')
+$$ LANGUAGE plcontainer;
+
+-- two full batches and one sent when the statement finishes
+select i, rbatch_void(i, array_fill(1, array[i])) from generate_series(1,10) i;
+-- the error of a batched row is raised by its statement
+select i, rbatch_void(i, array[1]) from generate_series(1,3) i;
+select rbatch_void(2, array[1]);
+-- rows of a rolled back subtransaction are dropped, the commit runs none
+BEGIN;
+SAVEPOINT s1;
+select rbatch_void(2, array[1]), 1/(i-1) from generate_series(1,1) i;
+ROLLBACK TO SAVEPOINT s1;
+COMMIT;
+
+RESET plcontainer.batch_size;
+
+DROP FUNCTION rbatch_void(int4, int4[]);
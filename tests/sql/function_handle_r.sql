@@ -0,0 +1,29 @@
+-- functions are registered once and then called by handle
+CREATE OR REPLACE FUNCTION rhandle(i int4) RETURNS int4 AS $$
+# container: plc_r_shared
+return (i + 1)
+$$ LANGUAGE plcontainer;
+
+select rhandle(1);
+select rhandle(i) from generate_series(1,3) i order by 1;
+
+-- a changed function is registered again, later calls use the new handle
+CREATE OR REPLACE FUNCTION rhandle(i int4) RETURNS int4 AS $$
+# container: plc_r_shared
+return (i + 100)
+$$ LANGUAGE plcontainer;
+
+select rhandle(1);
+select rhandle(2);
+
+-- a new function of the same name gets its own registration
+DROP FUNCTION rhandle(int4);
+CREATE OR REPLACE FUNCTION rhandle(i int4) RETURNS int4 AS $$
+# container: plc_r_shared
+return (i * 2)
+$$ LANGUAGE plcontainer;
+
+select rhandle(1);
+select rhandle(2);
+
+DROP FUNCTION rhandle(int4);
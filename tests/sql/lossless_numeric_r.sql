@@ -0,0 +1,24 @@
+-- bigint and numeric values pass through the runtime exactly
+SET plcontainer.lossless_numeric = on;
+
+CREATE OR REPLACE FUNCTION rlossless_int8(i int8) RETURNS int8 AS $$
+# container: plc_r_shared
+return (i)
+$$ LANGUAGE plcontainer;
+
+CREATE OR REPLACE FUNCTION rlossless_numeric(n numeric) RETURNS numeric AS $$
+# container: plc_r_shared
+return (n)
+$$ LANGUAGE plcontainer;
+
+-- above 2^53, not representable as float8
+select rlossless_int8(9007199254740993);
+select rlossless_int8(9223372036854775807);
+select rlossless_int8(9007199254740993) = 9007199254740993 as exact;
+select rlossless_numeric(12345678901234567890.123456789012345678);
+select rlossless_numeric(-0.000000000000000000000000000001);
+
+RESET plcontainer.lossless_numeric;
+
+DROP FUNCTION rlossless_int8(int8);
+DROP FUNCTION rlossless_numeric(numeric);
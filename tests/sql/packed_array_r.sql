@@ -0,0 +1,32 @@
+-- arrays of fixed width types are sent as one packed buffer
+SET plcontainer.packed_array = on;
+
+CREATE OR REPLACE FUNCTION rpacked_sum(a float8[]) RETURNS float8 AS $$
+# container: plc_r_shared
+return (sum(a, na.rm = TRUE))
+$$ LANGUAGE plcontainer;
+
+CREATE OR REPLACE FUNCTION rpacked_count(a int4[]) RETURNS int4 AS $$
+# container: plc_r_shared
+return (length(a))
+$$ LANGUAGE plcontainer;
+
+CREATE OR REPLACE FUNCTION rpacked_double(a int8[]) RETURNS int8[] AS $$
+# container: plc_r_shared
+return (a * 2)
+$$ LANGUAGE plcontainer;
+
+select rpacked_sum(array[1.5, 2.5, 3]::float8[]);
+select rpacked_sum(array[1.5, null, 3]::float8[]);
+select rpacked_count(array(select generate_series(1, 100000)));
+select rpacked_double(array[1, 2, 3]::int8[]);
+
+RESET plcontainer.packed_array;
+
+-- the same without packing
+select rpacked_sum(array[1.5, null, 3]::float8[]);
+select rpacked_double(array[1, 2, 3]::int8[]);
+
+DROP FUNCTION rpacked_sum(float8[]);
+DROP FUNCTION rpacked_count(int4[]);
+DROP FUNCTION rpacked_double(int8[]);
@@ -111,6 +111,7 @@ select rtestudt1( ('t', 1, 2, 3, 4, 5, 6, 'foobar')::test_type );
 
 select rtestudt6a();
 select rtestudt6b();
+select * from rtestudt6b();
 --start_ignore
 --select rtestudt8();
 --select rtestudt11();